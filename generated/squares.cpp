@@ -6,13 +6,31 @@
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <math.h>
 #include <string>
 #include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <regex>
+
+#include "asyncWriter.hpp"
+#include "cellArchive.hpp"
+#include "cellInfo.hpp"
+#include "cellOutput.hpp"
+#include "daemonServer.hpp"
+#include "hashing.hpp"
+#include "manifestWriter.hpp"
+#include "pageLoader.hpp"
+#include "pageProcessor.hpp"
+#include "pageStream.hpp"
+#include "runJournal.hpp"
+#include "trace.hpp"
 #define GET_NAME(variable) (#variable)
 
 
@@ -31,112 +49,8 @@ static void help()
 }
 
 
-int thresh = 50, N = 5;
 const char* wndname = "Square Detection Demo";
 
-// helper function:
-// finds a cosine of angle between vectors
-// from pt0->pt1 and from pt0->pt2
-static double angle(cv::Point pt1, cv::Point pt2, cv::Point pt0)
-{
-	double dx1 = pt1.x - pt0.x;
-	double dy1 = pt1.y - pt0.y;
-	double dx2 = pt2.x - pt0.x;
-	double dy2 = pt2.y - pt0.y;
-	return (dx1*dx2 + dy1*dy2) / sqrt((dx1*dx1 + dy1*dy1)*(dx2*dx2 + dy2*dy2) + 1e-10);
-}
-
-// returns sequence of squares detected on the image.
-// the sequence is stored in the specified memory storage
-static void findSquares(const cv::Mat& image, vector<vector<cv::Point> >& squares)
-{
-	squares.clear();
-
-	//s    cv::Mat pyr, timg, gray0(image.size(), CV_8U), gray;
-
-	// down-scale and upscale the image to filter out the noise
-	//pyrDown(image, pyr, Size(image.cols/2, image.rows/2));
-	//pyrUp(pyr, timg, image.size());
-
-
-	// blur will enhance edge detection
-	
-	cv::Mat timg(image);
-	//medianBlur(image, timg, 9);
-	cv::Mat gray0(timg.size(), CV_8U), gray;
-	
-	vector<vector<cv::Point> > contours;
-
-	// find squares in every color plane of the image
-	for (int c = 0; c < 3; c++)
-	{
-		int ch[] = { c, 0 };
-		mixChannels(&timg, 1, &gray0, 1, ch, 1);
-
-		// try several threshold levels
-		for (int l = 0; l < N; l++)
-		{
-			// hack: use Canny instead of zero threshold level.
-			// Canny helps to catch squares with gradient shading
-			if (l == 0)
-			{
-				// apply Canny. Take the upper threshold from slider
-				// and set the lower to 0 (which forces edges merging)
-				Canny(gray0, gray, 5, thresh, 5);
-				// dilate canny output to remove potential
-				// holes between edge segments
-				dilate(gray, gray, cv::Mat(), cv::Point(-1, -1));
-			}
-			else
-			{
-				// apply threshold if l!=0:
-				//     tgray(x,y) = gray(x,y) < (l+1)*255/N ? 255 : 0
-				gray = gray0 >= (l + 1) * 255 / N;
-			}
-
-			// find contours and store them all as a list
-			findContours(gray, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
-
-			vector<cv::Point> approx;
-
-			// test each contour
-			for (size_t i = 0; i < contours.size(); i++)
-			{
-				// approximate contour with accuracy proportional
-				// to the contour perimeter
-				approxPolyDP(cv::Mat(contours[i]), approx, arcLength(cv::Mat(contours[i]), true)*0.02, true);
-
-				// square contours should have 4 vertices after approximation
-				// relatively large area (to filter out noisy contours)
-				// and be convex.
-				// Note: absolute value of an area is used because
-				// area may be positive or negative - in accordance with the
-				// contour orientation
-				if (approx.size() == 4 &&
-					fabs(contourArea(cv::Mat(approx))) > 1000 &&
-					isContourConvex(cv::Mat(approx)))
-				{
-					double maxCosine = 0;
-
-					for (int j = 2; j < 5; j++)
-					{
-						// find the maximum cosine of the angle between joint edges
-						double cosine = fabs(angle(approx[j % 4], approx[j - 2], approx[j - 1]));
-						maxCosine = MAX(maxCosine, cosine);
-					}
-
-					// if cosines of all angles are small
-					// (all angles are ~90 degree) then write quandrange
-					// vertices to resultant sequence
-					if (maxCosine < 0.3)
-						squares.push_back(approx);
-				}
-			}
-		}
-	}
-}
-
-
 // the function draws all the squares in the image
 static void drawSquares(cv::Mat& image, const vector<vector<cv::Point> >& squares, cv::Scalar color)
 {
@@ -153,36 +67,6 @@ static void drawSquares(cv::Mat& image, const vector<vector<cv::Point> >& square
 	imshow(wndname, image);
 }
 
-typedef vector<cv::Point> square_t;
-
-// returns true if cv::PointA < cv::PointB
-// orders points by row first, then column
-bool compare_points(cv::Point& pointA, cv::Point& pointB, float proximity_tolerance) {
-	if (pointA.y < pointB.y - proximity_tolerance) return true;
-	if (pointA.y > pointB.y + proximity_tolerance) return false;
-	if (pointA.x < pointB.x - proximity_tolerance) return true;
-	return false;
-}
-
-// returns true if the upper left corner of a is < ulc of b
-bool compare_square_t(square_t& a, square_t& b) {
-	cv::Point pointA = a[0], pointB = b[0];
-	return compare_points(pointA, pointB, 50);
-}
-
-int upperLeft(square_t& sq) {
-	int idx = 0;
-	cv::Point min = sq[0];
-	for (int i = 1; i < sq.size(); i++) {
-		if (sq[i].x <= min.x && abs(sq[i].y - min.y) < 20 ) {
-			min = sq[i];
-			idx = i;
-		}
-	}
-	return idx;
-}
-
-
 void printSquares(vector<square_t>& squares, string filename) {
 	ofstream myfile2;
 	myfile2.open("C:/Users/sbeaulie/Desktop/" + filename);
@@ -198,362 +82,516 @@ void printSquares(vector<square_t>& squares, string filename) {
 	myfile2.close();
 }
 
-void filterBySize(vector<square_t>& in, vector<square_t>& out) {
-	
-	for (int i = 0; i < in.size(); i++)
-	{
-		//def des points
-		cv::Point p1 = in[i][0];
-		cv::Point p2 = in[i][1];
-		cv::Point p3 = in[i][2];
-		cv::Point p4 = in[i][3];
-
-		//calcul de taille du carr
-		int distancex = (p2.x - p1.x) ^ 2;
-		int distancey = (p2.y - p1.y) ^ 2;
-
-		double width = sqrt(abs(distancex - distancey));
-
-		if (width > 15.5 && width<17) {
-			vector<cv::Point> points;
-			points.push_back(p1);
-			points.push_back(p2);
-			points.push_back(p3);
-			points.push_back(p4);
-			out.push_back(points);
-		}
-	}
-}
-
-// rotate each square so that the upper left corner is the first cv::Point
-void rotateSquares(vector<square_t>& squaresBis) {
-	for (square_t& sq : squaresBis) {
-		int mouv = upperLeft(sq);
-		vector<cv::Point> inter = sq;
-		sq[(0 + mouv) % 4] = inter[0];
-		sq[(1 + mouv) % 4] = inter[1];
-		sq[(2 + mouv) % 4] = inter[2];
-		sq[(3 + mouv) % 4] = inter[3];
-	}
-}
-
-
-bool squaresOverlap(square_t& a, square_t& b, float tolX, float tolY) {
-	cv::Point pointA = a[0], pointB = b[0];
-	return abs(pointB.x - pointA.x) < 160 && abs(pointB.y - pointA.y) < 320;
-}
 
-void filterOverlappingSquares(vector<square_t>& in, vector<square_t>& out, float tolX, float tolY) {
-	std::sort(in.begin(), in.end(), compare_square_t);
+// rgx: pattern of the page paths, the scripter then the page number
+string* parseInputName(string filePath, const std::regex& rgx) {
+	//std::regex rgx(".*/s(\\d\\d)_(.+).png");
+	std::smatch matches;
 
-	for (auto sq : in) {
-		if (out.size() == 0
-			|| !squaresOverlap(out[out.size() - 1], sq, tolX, tolY)) {
-			out.push_back(sq);
-		}
+	if (std::regex_match(filePath, matches, rgx)) {
+		return new string[2]{ matches[1], matches[2] };
+	} else {
+		throw "Incorrect input filename\n";
 	}
 }
 
-
-bool areSameRow(square_t a, square_t b, float tolY) {
-	return std::abs(a[0].y - b[0].y) < tolY;
+// hash of everything that changes the outputs of a page once its layout is known:
+// classification parameters, template bank and output layout
+uint64_t classificationHash(const PageProcessor& processor, const string& outputLayout) {
+	uint64_t hash = processor.classificationHash();
+	return fnv1a64(outputLayout.data(), outputLayout.size(), hash);
 }
 
-vector<vector<square_t>> groupByRow(vector<square_t>& squares) {
-	//Trier les carrs par lignes
-	vector<vector<square_t>> lignes;
-
-	std::sort(squares.begin(), squares.end(), compare_square_t);
+struct CellResult {
+	CellInfo info;
+	cv::Rect rect;
+	string output; // png file, or key of the cell in the archive
+};
+
+struct PageResult {
+	PageLayout layout;
+	vector<vector<square_t>> rows;
+	vector<CellResult> cells;
+	vector<string> outputs; // every file or key written for the page
+	size_t blankCells = 0;  // metadata only, under config.minInkRatio
+};
+
+// Detects the cells of a page, or labels those of its known layout, and submits
+// their crops to the output.
+// The crops are copied when submitted: image may change once this returns.
+// Returns false when the page name doesn't match namePattern.
+bool processPage(const cv::Mat& image, const string& path, const std::regex& namePattern, const PageProcessor& processor,
+	const PageLayout* knownLayout, CellOutput& output, PageResult& result)
+{
+	TRACE_SCOPE("processPage");
+	result = PageResult();
 
-	vector<square_t> currentRow;
+	string scripterNumber, pageNumber;
+	try
+	{
+		string* parsed = parseInputName(path, namePattern);
+		scripterNumber = parsed[0];
+		pageNumber = parsed[1];
+		delete[] parsed;
+	}
+	catch (const char* error)
+	{
+		cout << path << ": " << error;
+		return false;
+	}
 
-	currentRow.push_back(squares[0]);
-	for (int i = 1; i < squares.size(); i++) {
-		if (!areSameRow(squares[i], squares[i - 1], 160)) {
-			lignes.push_back(currentRow);
-			currentRow = vector<square_t>();
+	PageCells page = knownLayout ? processor.reclassify(image, *knownLayout) : processor.process(image);
+	result.layout = page.layout;
+	result.rows.swap(page.rows);
+	cout << page.cells.size() << endl;
+
+	for (const DetectedCell& found : page.cells) {
+		CellResult cellResult;
+		CellInfo& cell = cellResult.info;
+		cell.label = found.label.name;
+		cell.size = found.label.size;
+		cell.scripter = scripterNumber;
+		cell.page = pageNumber;
+		cell.row = found.row;
+		cell.column = found.column;
+		if (found.ink.measured())
+		{
+			cell.inkRatio = (float)found.ink.ratio;
+			cell.inkX = found.ink.box.x;
+			cell.inkY = found.ink.box.y;
+			cell.inkWidth = found.ink.box.width;
+			cell.inkHeight = found.ink.box.height;
+			cell.inkCenterX = found.ink.center.x;
+			cell.inkCenterY = found.ink.center.y;
+			// empty cell: its metadata and ink are written, not its crop
+			if (found.ink.ratio < processor.config().minInkRatio)
+			{
+				output.writeBlank(cell, result.outputs);
+				result.blankCells++;
+				continue;
+			}
 		}
-		currentRow.push_back(squares[i]);
+
+		// Cropped square
+		cellResult.rect = found.rect;
+		cellResult.output = output.write(cell, page.crop(image, found.rect), result.outputs);
+		if (!output.isArchive()) cout << cellResult.output << endl;
+		result.cells.push_back(cellResult);
 	}
-	lignes.push_back(currentRow);
-	return lignes;
+	return true;
 }
 
+static const char* keys =
+	"{help h   |      | print this message}"
+	"{@input   |W:/p/p12/5info/irfBD/NicIcon/w003-scans/00305.png| pages to process: .../wNNN-scans/page.png, a directory of pages or a .txt listing one page per line}"
+	"{pattern  |.*/w(\\d\\d\\d)-scans/(.+).png| regular expression of the page paths: its groups are the scripter and the page numbers}"
+	"{readahead|4     | number of upcoming pages prefetched during the processing of a page}"
+	"{config   |      | detection configuration (.yml, .xml or .json, see squares_tune)}"
+	"{engine   |      | square detection engine, overrides the configuration (contours by default)}"
+	"{ink      |      | record the ink statistics of the cells in their metadata}"
+	"{skipblank|      | don't write the cells whose ink ratio is under this value (0.01...), overrides the configuration}"
+	"{templates|C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/| directory of the symbol and size templates}"
+	"{output o |C:/Users/sbeaulie/Desktop/ComputedImages/| output directory}"
+	"{format   |files | output layout: files (png + txt per cell) or archive (pack + index)}"
+	"{shard    |0     | archive shard number, one per concurrent run}"
+	"{metadata |manifest| metadata of the files layout: manifest (one file for the run) or txt (one per cell)}"
+	"{manifest |manifest.csv| manifest file in the output directory, .csv or .jsonl}"
+	"{journal  |run.journal| run journal in the output directory: pages already done with the same input and configuration are skipped}"
+	"{force    |      | reprocess the pages already in the journal}"
+	"{checkpoint|20   | pages between two checkpoints of the outputs and of the journal}"
+	"{stdin    |      | streaming: process the page paths read from stdin, one per line}"
+	"{spool    |      | streaming: process the pages written to this directory}"
+	"{done     |      | streaming: directory where the processed pages are moved}"
+	"{rejected |      | streaming: directory where the pages that can't be processed are moved (path not matching -pattern, still undecodable after retries)}"
+	"{window   |100   | streaming: milliseconds to gather a micro-batch of pages}"
+	"{batch    |8     | streaming: maximum number of pages of a micro-batch}"
+	"{daemon   |      | serve the page paths sent on a Unix domain socket, see squares_client}"
+	"{socket   |/tmp/squares.sock| socket of the daemon}"
+	"{trace    |      | write a Chrome trace of the run to this file (trace_event JSON, opens in Perfetto)}"
+	"{nogui    |      | don't display the detected squares}";
+
+int main(int argc, char** argv)
+{
+	cv::CommandLineParser parser(argc, argv, keys);
+	if (parser.has("help"))
+	{
+		help();
+		parser.printMessage();
+		return 0;
+	}
 
+	const string traceFile = parser.get<cv::String>("trace");
+	if (!traceFile.empty())
+	{
+		Tracer::enable();
+		Tracer::setThreadName("main");
+	}
 
+	const string imgPath = parser.get<cv::String>("@input");
+	string ComputedImagesPrefix = parser.get<cv::String>("output");
+	if (!ComputedImagesPrefix.empty() && ComputedImagesPrefix.back() != '/' && ComputedImagesPrefix.back() != '\\')
+		ComputedImagesPrefix += "/";
+	DetectionConfig config;
+	if (!loadConfigOption(parser, config)) return 1;
+	const string engine = parser.get<cv::String>("engine");
+	if (!engine.empty()) config.engine = engine;
+	if (parser.has("ink")) config.inkStats = true;
+	if (parser.has("skipblank")) config.minInkRatio = parser.get<double>("skipblank");
+	const string format = parser.get<cv::String>("format");
+	const string metadata = parser.get<cv::String>("metadata");
+	const string spool = parser.get<cv::String>("spool");
+	const string doneDirectory = parser.get<cv::String>("done");
+	const string rejectedDirectory = parser.get<cv::String>("rejected");
+	std::regex namePattern;
+	try
+	{
+		namePattern = std::regex(string(parser.get<cv::String>("pattern")));
+	}
+	catch (const std::regex_error& error)
+	{
+		cout << "Incorrect -pattern: " << error.what() << endl;
+		return 1;
+	}
+	if (namePattern.mark_count() != 2)
+	{
+		cout << "-pattern needs two groups: the scripter and the page numbers" << endl;
+		return 1;
+	}
+	const bool daemon = parser.has("daemon");
+	const bool streaming = parser.has("stdin") || !spool.empty() || daemon;
+	const bool gui = !parser.has("nogui") && !streaming;
+	if (format != "files" && format != "archive")
+	{
+		cout << "Unknown output format " << format << endl;
+		return 1;
+	}
+	if (metadata != "manifest" && metadata != "txt")
+	{
+		cout << "Unknown metadata layout " << metadata << endl;
+		return 1;
+	}
 
-//charge la base de template // TODO clean that up
-static vector<cv::Mat> base;
-
-string path_template = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/accident.png";
-cv::Mat accident = cv::imread(path_template);
-
-string path_template2 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/bomb.png";
-cv::Mat bomb = cv::imread(path_template2);
-
-string path_template3 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/car.png";
-cv::Mat car = cv::imread(path_template3);
-
-string path_template4 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/casualty.png";
-cv::Mat casualty = cv::imread(path_template4);
-
-string path_template5 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/electricity.png";
-cv::Mat electricity = cv::imread(path_template5);
-
-string path_template6 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/fire.png";
-cv::Mat fire = cv::imread(path_template6);
-
-string path_template7 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/fireBrigade.png";
-cv::Mat fireBrigade = cv::imread(path_template7);
-
-string path_template8 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/flood.png";
-cv::Mat flood = cv::imread(path_template8);
-
-string path_template9 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/gas.png";
-cv::Mat gas = cv::imread(path_template9);
-
-string path_template10 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/injury.png";
-cv::Mat injury = cv::imread(path_template10);
-
-string path_template11 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/paramedics.png";
-cv::Mat paramedics = cv::imread(path_template11);
-
-string path_template12 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/person.png";
-cv::Mat person = cv::imread(path_template12);
-
-string path_template13 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/police.png";
-cv::Mat police = cv::imread(path_template13);
-
-string path_template14 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/roadBlock.png";
-cv::Mat roadBlock = cv::imread(path_template14);
-
-
-string path_template15 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/small.png";
-cv::Mat small = cv::imread(path_template15);
-
-string path_template16 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/medium.png";
-cv::Mat medium = cv::imread(path_template16);
+	//Remplissage du vecteur base
+	shared_ptr<TemplateBank> templates = make_shared<TemplateBank>();
+	if (!templates->load(parser.get<cv::String>("templates"))) return 1;
 
-string path_template17 = "C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/templates/large.png";
-cv::Mat large = cv::imread(path_template17);
+	const PageProcessor processor(config, templates);
+	if (!processor.isValid())
+	{
+		cout << "Unknown engine " << config.engine << endl;
+		return 1;
+	}
 
+	// pages: a fixed list, or micro-batches of the pages arriving on stdin or in the spool
+	PageStream stream;
+	if (daemon) stream.setPages(vector<string>()); // the pages come from the socket
+	else if (parser.has("stdin")) stream.readStdin();
+	else if (!spool.empty()) stream.watchDirectory(spool);
+	else stream.setPages(PageLoader::listInputs(imgPath));
+	const int windowMs = parser.get<int>("window");
+	const size_t maxBatch = streaming ? (size_t)std::max(1, parser.get<int>("batch")) : SIZE_MAX;
+
+	// pages done by a previous run with the same configuration are skipped,
+	// those done with the same detection configuration are only labelled again
+	const uint64_t detectionHash = processor.detectionHash();
+	const uint64_t labelsHash = classificationHash(processor, format + "|" + metadata + "|" + ComputedImagesPrefix);
+	const string journalName = parser.get<cv::String>("journal");
+	RunJournal journal;
+	if (!journalName.empty() && !journal.open(ComputedImagesPrefix + journalName))
+	{
+		cout << "Couldn't open journal " << ComputedImagesPrefix + journalName << endl;
+		return 1;
+	}
+	const bool force = parser.has("force");
 
-string* whatSymbols(cv::Mat source) {
+	const int readAhead = parser.get<int>("readahead");
+	const int checkpointPages = std::max(1, parser.get<int>("checkpoint"));
+	
+	help();
+	if (gui) cv::namedWindow(wndname, cv::WINDOW_NORMAL);
 
-	double maxResult=0.0;
-	string symbolName;
-	int indice = 0;
-	cv::Mat bestResult;
-	// Symbole le plus ressemblant
-	for (int i = 0; i < base.size();i++) {
-		cv::Mat result;
-		matchTemplate(source, base[i], result, CV_TM_CCOEFF_NORMED);
-		//permet la rcupration du point d'intrt (haut a gauche) le plus probable
-		double min, max;
-		cv::Point locationMin;
-		cv::Point locationMax;
-		minMaxLoc(result, &min, &max, &locationMin, &locationMax);
+	// crops and metadata are encoded and written by worker threads
+	AsyncWriter writer;
 
-		if (max>maxResult) {
-			maxResult = max;
-			indice = i;
-			bestResult = result;
+	// archive layout: one pack + index per shard instead of two files per cell
+	ArchiveWriter archive;
+	if (format == "archive")
+	{
+		string archiveBase = ComputedImagesPrefix + "cells_" + to_string(parser.get<int>("shard"));
+		if (!archive.open(archiveBase))
+		{
+			cout << "Couldn't open archive " << archiveBase << endl;
+			return 1;
 		}
 	}
-//	cv::namedWindow("res", cv::WINDOW_NORMAL);
-//	cv::imshow("res", bestResult);
-
-
-	switch (indice) {
-	case 0: symbolName = "accident"; break;
-	case 1: symbolName = "bomb"; break;
-	case 2: symbolName = "car"; break;
-	case 3: symbolName = "casualty"; break;
-	case 4: symbolName = "electricity"; break;
-	case 5: symbolName = "fire"; break;
-	case 6: symbolName = "fireBrigade"; break;
-	case 7: symbolName = "flood"; break;
-	case 8: symbolName = "gas"; break;
-	case 9: symbolName = "injury"; break;
-	case 10: symbolName = "paramedics"; break;
-	case 11: symbolName = "person"; break;
-	case 12: symbolName = "police"; break;
-	case 13: symbolName = "roadBlock"; break;
+
+	// the archive index already holds the metadata of its cells
+	ManifestWriter manifest;
+	if (format == "files" && metadata == "manifest")
+	{
+		string manifestPath = ComputedImagesPrefix + string(parser.get<cv::String>("manifest"));
+		if (!manifest.open(manifestPath, ManifestWriter::formatFromPath(manifestPath), config.measuresInk()))
+		{
+			cout << "Couldn't open manifest " << manifestPath << endl;
+			return 1;
+		}
 	}
 
-	// taille de l'image
-
-	double maxResult1 = 0.0;
-	string symbolTaille;
-	int couleur= 0;
-	// Symbole le plus ressemblant
-	for (int i = 0; i < 3; i++) {
-		cv::Mat result;
-		cv::Mat choix;
-		if (i == 0) {
-			choix = small;
+	// the journal only records pages whose outputs are on disk: the pages done since
+	// the last checkpoint are marked once every write went through, else they are redone
+	struct DonePage {
+		string path;
+		RunJournal::Entry entry;
+		vector<string> previousOutputs; // of the former run of a redone page
+	};
+	vector<DonePage> pendingPages;
+	auto donePage = [&](const LoadedPage& loaded, const PageResult& result) {
+		// the size, time and hash of the file when it was read
+		DonePage done;
+		done.path = loaded.path;
+		done.entry.fileSize = loaded.fileSize;
+		done.entry.modificationTime = loaded.modificationTime;
+		done.entry.contentHash = loaded.contentHash;
+		done.entry.detectionHash = detectionHash;
+		done.entry.classificationHash = labelsHash;
+		done.entry.outputs = result.outputs;
+		done.entry.layout = result.layout.toString();
+		const RunJournal::Entry* previous = journal.find(loaded.path);
+		if (previous != NULL) done.previousOutputs = previous->outputs;
+		return done;
+	};
+	// removes the outputs of the former run of a redone page that this run didn't write
+	// again (cells gone or renamed by a new label), once the new ones are on disk.
+	// A cell of an archive is dropped from its index; the manifest rows of the former
+	// run stay, superseded by the rows of the page that follow them.
+	auto removeStaleOutputs = [&](const DonePage& done) {
+		vector<string> keys;
+		for (const string& previous : done.previousOutputs)
+		{
+			if (std::find(done.entry.outputs.begin(), done.entry.outputs.end(), previous) != done.entry.outputs.end()) continue;
+			size_t separator = previous.rfind('#');
+			if (archive.isOpen() && separator == archive.path().size() && previous.compare(0, separator, archive.path()) == 0)
+				keys.push_back(previous.substr(separator + 1));
+			else std::remove(previous.c_str()); // nothing to do for the cell of another shard
 		}
-		else if (i == 1) {
-			choix = medium;
+		if (!keys.empty()) archive.remove(keys);
+	};
+	uint64_t writeErrors = 0; // of the writer, at the last checkpoint
+	auto checkpointOutputs = [&]() {
+		TRACE_SCOPE("checkpoint");
+		writer.flush();
+		uint64_t errors = writer.stats().errors;
+		bool ok = errors == writeErrors;
+		writeErrors = errors;
+		if (ok)
+		{
+			for (const DonePage& done : pendingPages) removeStaleOutputs(done);
 		}
-		else {
-			choix = large;
+		if (archive.isOpen()) ok = archive.checkpoint() && ok;
+		if (manifest.isOpen()) ok = manifest.checkpoint() && ok;
+		if (ok)
+		{
+			for (const DonePage& done : pendingPages) journal.markDone(done.path, done.entry);
+			if (journal.isOpen()) ok = journal.commit();
 		}
-		matchTemplate(source, choix, result, CV_TM_CCOEFF_NORMED);
-
-		//permet la rcupration du point d'intrt (haut a gauche) le plus probable
-		double min, max;
-		cv::Point locationMin;
-		cv::Point locationMax;
-		minMaxLoc(result, &min, &max, &locationMin, &locationMax);
-		if (max>maxResult1) {
-			maxResult1 = max;
-			couleur= i;
+		else if (!pendingPages.empty()) cout << "write errors: the last " << pendingPages.size() << " pages aren't journaled" << endl;
+		pendingPages.clear();
+		return ok;
+	};
+	int pagesDone = 0;
+
+	CellOutput output(writer, archive, manifest, ComputedImagesPrefix);
+
+	// streaming: once a batch is on disk its pages are moved to the done directory,
+	// the pages that can't be processed to the rejected directory
+	vector<string> batch, finished, undecoded, rejected;
+	auto moveTo = [](const string& path, const string& directory) {
+		if (directory.empty()) return;
+		string name = path.substr(path.find_last_of("/\\") + 1);
+		if (std::rename(path.c_str(), (directory + "/" + name).c_str()) != 0)
+			cout << "Couldn't move " << path << " to " << directory << endl;
+	};
+	auto finishBatch = [&]() {
+		if (!streaming) return;
+		// a failed checkpoint leaves the pages in the spool for the next run
+		if (checkpointOutputs())
+		{
+			for (const string& path : finished) moveTo(path, doneDirectory);
 		}
-	}
-	switch (couleur) {
-	case 0: symbolTaille = "small"; break;
-	case 1: symbolTaille = "medium";  break;
-	case 2: symbolTaille = "large"; break;
-
-	}
-	
-	return new string[2]{ symbolName, symbolTaille };
-
-}
-
+		finished.clear();
+		for (const string& path : batch)
+		{
+			// an undecodable page may still be being written: it is retried first
+			if (std::find(undecoded.begin(), undecoded.end(), path) == undecoded.end()) stream.pageDone(path);
+			else if (stream.pageFailed(path)) rejected.push_back(path);
+		}
+		undecoded.clear();
+		for (const string& path : rejected)
+		{
+			if (rejectedDirectory.empty()) cout << path << " is left in the spool" << endl;
+			moveTo(path, rejectedDirectory);
+		}
+		rejected.clear();
+	};
+
+	// layout journaled for a page loaded with the same content and detection configuration
+	auto knownLayout = [&](const LoadedPage& loaded, PageLayout& layout) {
+		const RunJournal::Entry* previous = journal.find(loaded.path);
+		return !force && previous != NULL && previous->detectionHash == detectionHash
+			&& previous->contentHash == loaded.contentHash && PageLayout::fromString(previous->layout, layout);
+	};
+
+	unique_ptr<PageLoader> pages;
+	auto nextPage = [&](LoadedPage& page) {
+		while (!pages || !pages->next(page))
+		{
+			if (pages) finishBatch();
+			if (!stream.nextBatch(batch, windowMs, maxBatch)) return false;
 
-string getFileName(string numRow, string numCol, string numScripteur, string numPage, string templateName, string templateSize) {
-	return templateName + "_" + numScripteur + "_" + numPage + "_" + numRow + "_" + numCol;
-}
+			vector<string> todo;
+			for (const string& input : batch)
+			{
+				if (force || !journal.isOpen() || journal.status(input, detectionHash, labelsHash) != RunJournal::DONE) todo.push_back(input);
+				else finished.push_back(input);
+			}
+			if (todo.size() < batch.size()) cout << batch.size() - todo.size() << " pages already done" << endl;
 
+			pages.reset(new PageLoader(todo, readAhead));
+			pages->setHashContent(journal.isOpen());
+		}
+		return true;
+	};
+
+	LoadedPage page;
+	double totalIoWaitMs = 0;
+	int pagesProcessed = 0;
+	size_t blankCells = 0;
+
+	// daemon: one request is a page path, the response lists its cells once they are on disk
+	DaemonServer server;
+	std::mutex pageMutex; // the pages are processed one at a time
+	auto handleRequest = [&](const string& request) {
+		Tracer::setThreadName("connection");
+		TRACE_SCOPE("request");
+		std::lock_guard<std::mutex> lock(pageMutex);
+
+		LoadedPage requested;
+		PageLoader loader(vector<string>(1, request), 0);
+		loader.setHashContent(journal.isOpen());
+		if (!loader.next(requested) || requested.image.empty()) return "ERROR couldn't load " + request + "\n";
+		totalIoWaitMs += requested.ioWaitMs;
+
+		PageResult result;
+		PageLayout layout;
+		const PageLayout* known = knownLayout(requested, layout) ? &layout : NULL;
+		if (!processPage(requested.image, requested.path, namePattern, processor, known, output, result)) return "ERROR incorrect input filename " + request + "\n";
+		TRACE_SCOPE("waitWrites");
+		writer.flush();
+		if (writer.stats().errors != writeErrors)
+		{
+			// not journaled: the page is redone by the next request or run
+			writeErrors = writer.stats().errors;
+			return "ERROR couldn't write the outputs of " + request + "\n";
+		}
 
-string* parseInputName(string filePath) {
-	std::regex rgx(".*/w(\\d\\d\\d)-scans/(.+).png");
-	//std::regex rgx(".*/s(\\d\\d)_(.+).png");
-	std::smatch matches;
+		pagesProcessed++;
+		blankCells += result.blankCells;
+		if (journal.isOpen())
+		{
+			pendingPages.push_back(donePage(requested, result));
+			if (++pagesDone % checkpointPages == 0) checkpointOutputs();
+		}
 
-	if (std::regex_match(filePath, matches, rgx)) {
-		return new string[2]{ matches[1], matches[2] };
-	} else {
-		throw "Incorrect input filename\n";
+		ostringstream response;
+		response << "OK " << result.cells.size() << "\n";
+		for (const CellResult& cell : result.cells)
+		{
+			response << cell.info.row << ' ' << cell.info.column << ' '
+				<< cell.rect.x << ' ' << cell.rect.y << ' ' << cell.rect.width << ' ' << cell.rect.height << ' '
+				<< cell.info.label << ' ' << cell.info.size << ' ' << cell.output << "\n";
+		}
+		return response.str();
+	};
+	if (daemon)
+	{
+		const string socketPath = parser.get<cv::String>("socket");
+		if (!server.listen(socketPath)) return 1;
+		cout << "listening on " << socketPath << endl;
+		server.serve(handleRequest); // until SIGINT or SIGTERM
 	}
-}
-
-int main(int /*argc*/, char** /*argv*/)
-{
 
-
-	const string imgPath = "W:/p/p12/5info/irfBD/NicIcon/w003-scans/00305.png";
-
-	string* parsed = parseInputName(imgPath); // TODO parse parameters
-	string scripterNumber = parsed[0];
-	string pageNumber = parsed[1];
-
-	string ComputedImagesPrefix = "C:/Users/sbeaulie/Desktop/ComputedImages/";
-
-
-
-
-	//Remplissage du vecteur base
-	base.push_back(accident);
-	base.push_back(bomb);
-	base.push_back(car);
-	base.push_back(casualty);
-	base.push_back(electricity);
-	base.push_back(fire);
-	base.push_back(fireBrigade);
-	base.push_back(flood);
-	base.push_back(gas);
-	base.push_back(injury);
-	base.push_back(paramedics);
-	base.push_back(person);
-	base.push_back(police);
-	base.push_back(roadBlock);
-
-	char * cstr = new char[imgPath.length() + 1];
-	std::strcpy(cstr, imgPath.c_str());
-
-	static const char* names[] = { cstr , 0 };
-	
-	help();
-	cv::namedWindow(wndname, cv::WINDOW_NORMAL);
-	vector<square_t> squares;
-
-	for (int i = 0; names[i] != 0; i++)
+	while (nextPage(page))
 	{
-		cv::Mat image = cv::imread(names[i], 1);
+		cv::Mat image = page.image;
 		if (image.empty())
 		{
-			cout << "Couldn't load " << names[i] << endl;
+			cout << "Couldn't load " << page.path << endl;
+			undecoded.push_back(page.path);
+			continue;
+		}
+		cout << page.path << ": io wait " << page.ioWaitMs << " ms, decode " << page.decodeMs << " ms" << endl;
+		totalIoWaitMs += page.ioWaitMs;
+
+		PageResult result;
+		PageLayout layout;
+		const PageLayout* known = knownLayout(page, layout) ? &layout : NULL;
+		if (known) cout << page.path << ": layout of the journal" << endl;
+		if (!processPage(image, page.path, namePattern, processor, known, output, result))
+		{
+			rejected.push_back(page.path);
 			continue;
 		}
 
-		findSquares(image, squares);
-	
-
-		vector<square_t> squaresBis;
-		filterBySize(squares, squaresBis);
-		rotateSquares(squaresBis);
-
-		vector<square_t> filtered;
-		filterOverlappingSquares(squaresBis, filtered, 160, 320);
-
-		cout << filtered.size()<< endl;
-
-		//drawSquares(image, filtered);
-		
-		auto lignes = groupByRow(filtered);
-
-		drawSquares(image, lignes[2], cv::Scalar(0, 255, 0));
-		
-
-		for (int k = 0; k < lignes.size(); k++) {
-			//Select interest zone 
-			cv::Mat source = cv::imread(imgPath);
-			cv::Mat subImage(source, cv::Rect(0, lignes[k][0][0].y, 600, 350));
-
-			string* templateAndSize = whatSymbols(subImage);
-			string numberRow = to_string(k+1);
-
-			for (int u = 0; u < lignes[k].size(); u++) {
-				string numberColumn = to_string(u+1);
-
-				// Cropped square
-				cv::Mat cropped(source, cv::Rect(lignes[k][u][0], lignes[k][u][2]));
-
-				auto filename = getFileName(numberRow, numberColumn, scripterNumber, pageNumber, templateAndSize[0], templateAndSize[1]);
-
-				cout << ComputedImagesPrefix + filename + ".png" << endl;
-
-				cv::imwrite(ComputedImagesPrefix + filename + ".png", cropped);
-
-				//String pour .txt
-
-
-				ofstream metadataFile;
-				metadataFile.open(ComputedImagesPrefix + filename + ".txt");
-				metadataFile << "# 2017 Groupe Beaulieu Fournier Saulnier\n"
-					<< "label " << templateAndSize[0] << endl
-					<< "form " << scripterNumber + pageNumber << endl
-					<< "scripter " << scripterNumber << endl
-					<< "page " << pageNumber << endl
-					<< "row " << numberRow << endl
-					<< "column " << numberColumn << endl
-					<< "size " << templateAndSize[1] << endl;
-
-
-				metadataFile.close();
-			}
+		if (gui && result.rows.size() > 2)
+		{
+			cv::Mat display = image.clone();
+			drawSquares(display, result.rows[2], cv::Scalar(0, 255, 0));
 		}
-		
 
+		pagesProcessed++;
+		blankCells += result.blankCells;
+		finished.push_back(page.path);
+		if (journal.isOpen())
+		{
+			pendingPages.push_back(donePage(page, result));
+			if (++pagesDone % checkpointPages == 0) checkpointOutputs();
+		}
 		
-		int c = cv::waitKey();
-		if ((char)c == 27)
-			break;
+		if (gui)
+		{
+			int c = cv::waitKey();
+			if ((char)c == 27)
+				break;
+		}
+	}
+	writer.flush();
+	bool journaled = !journal.isOpen() || checkpointOutputs();
+	cout << "pages: " << pagesProcessed << ", io wait " << totalIoWaitMs << " ms" << endl;
+	if (config.minInkRatio > 0) cout << "blank cells (metadata only): " << blankCells << endl;
+	writer.printStats(cout);
+	if (archive.isOpen())
+	{
+		size_t cells = archive.count();
+		if (!archive.close()) return 1;
+		cout << "archive: " << cells << " cells" << endl;
+	}
+	if (manifest.isOpen())
+	{
+		uint64_t rows = manifest.rows();
+		if (!manifest.close()) return 1;
+		cout << "manifest: " << rows << " rows" << endl;
+	}
+	if (!journaled) return 1;
+	processor.printStats(cout);
+	if (!traceFile.empty())
+	{
+		if (!Tracer::exportChromeTrace(traceFile))
+		{
+			cout << "Couldn't write trace " << traceFile << endl;
+			return 1;
+		}
+		cout << "trace: " << traceFile << endl;
 	}
-	delete[] cstr;
 	return 0;
 }
 
@@ -0,0 +1,107 @@
+#ifndef ASYNCWRITER_H_
+#define ASYNCWRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "ioRing.hpp"
+
+/*
+* Output thread pool: crops are PNG-encoded and files are written on worker
+* threads so that the compute thread never blocks on the file system.
+* Workers take the queued tasks by batches. The files of a batch are created
+* and written through an io_uring of the worker (IoRing) when the system has
+* one, one by one otherwise. The bytes kept alive by queued tasks are bounded
+* by maxInFlightBytes: submitting blocks until the workers catch up.
+*/
+class AsyncWriter {
+public:
+	typedef std::function<void()> Task;
+
+	struct Stats {
+		uint64_t files = 0;
+		uint64_t bytes = 0;
+		uint64_t errors = 0;
+		uint64_t ringFiles = 0; // written through io_uring
+		size_t peakInFlightBytes = 0;
+	};
+
+	// useIoRing false: the files are always written by the workers one by one
+	AsyncWriter(int numThreads = 2, size_t maxInFlightBytes = 64 << 20, size_t batchSize = 16, bool useIoRing = true);
+	~AsyncWriter();
+
+	// Encodes image to PNG on a worker then writes it to path.
+	// A ROI is copied first, so that its page isn't held by the queue.
+	// onWritten, if any, is run on the worker once the file is written.
+	void writeImage(const std::string& path, const cv::Mat& roi, Task onWritten = Task());
+	void writeText(const std::string& path, const std::string& text);
+
+	// Runs task on a worker, bytes is the memory it holds (for the backpressure)
+	void submit(size_t bytes, Task task);
+	// Counts a failure of a submitted task in the errors of the stats
+	void countError() { errors++; }
+
+	// Waits until every submitted task is done
+	void flush();
+
+	Stats stats() const;
+	void printStats(std::ostream& out) const;
+
+	// Writes a whole file at once, returns false on failure.
+	// Successful writes are counted in the stats.
+	bool writeFile(const std::string& path, const void* data, size_t size);
+
+private:
+	struct Job {
+		size_t bytes;
+		Task task;
+	};
+
+	// file produced by a task, written at the end of its batch
+	struct PendingWrite {
+		std::string path;
+		std::vector<uchar> data;
+		Task onWritten;
+	};
+
+	size_t maxInFlightBytes;
+	size_t batchSize;
+	bool useIoRing;
+
+	mutable std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobDone;
+	std::deque<Job> queue;
+	size_t inFlightBytes = 0;
+	size_t pendingJobs = 0;
+	bool stopping = false;
+
+	std::atomic<uint64_t> files;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> errors;
+	std::atomic<uint64_t> ringFiles;
+	size_t peakInFlightBytes = 0;
+
+	std::vector<std::thread> workers;
+
+	void workerLoop(int index);
+	// on a worker: queued for the end of the batch; elsewhere: written at once
+	void queueWrite(PendingWrite write);
+	void writePending(IoRing& ring, std::vector<PendingWrite>& writes);
+	void runOnWritten(const PendingWrite& write);
+
+	// files of the batch run by the calling worker, NULL outside the workers
+	static thread_local std::vector<PendingWrite>* batchWrites;
+};
+
+#endif /* ASYNCWRITER_H_ */
@@ -0,0 +1,58 @@
+#ifndef BITMASK_H_
+#define BITMASK_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+/*
+* Binary image packed 1 bit per pixel, 64 pixels per word: pixel x of a row
+* is bit x % 64 of word x / 64. The bits past the last column stay clear.
+* 8 times less memory than a 0/255 CV_8U mask; the bitwise operations and
+* the counts work on whole words, toMat unpacks for the OpenCV consumers.
+*/
+class BitMask {
+public:
+	BitMask() {}
+	explicit BitMask(cv::Size size); // all clear
+
+	// masks[i]: pixels of plane (CV_8U) >= thresholds[i], all the levels
+	// packed in one read of plane, 8 pixels per operation
+	static void fromThresholds(const cv::Mat& plane, const std::vector<int>& thresholds, std::vector<BitMask>& masks);
+	static BitMask fromThreshold(const cv::Mat& plane, int threshold);
+
+	int rows() const { return height; }
+	int cols() const { return width; }
+	bool empty() const { return words.empty(); }
+	size_t bytes() const { return words.size() * sizeof(uint64_t); }
+
+	uint64_t* row(int y) { return words.data() + (size_t)y * stride; }
+	const uint64_t* row(int y) const { return words.data() + (size_t)y * stride; }
+
+	// same size masks
+	BitMask& operator&=(const BitMask& other);
+	BitMask& operator|=(const BitMask& other);
+	// pixels set in this mask but not in other
+	BitMask& subtract(const BitMask& other);
+
+	// dilation by a 3x3 square, as cv::dilate with the default kernel
+	BitMask dilated() const;
+
+	// pixels set, in the whole mask or in roi
+	int64_t count() const;
+	int64_t count(const cv::Rect& roi) const;
+	// pixels set in only one of the masks
+	int64_t countDifferent(const BitMask& other) const;
+
+	// 0/255 CV_8U image of roi
+	cv::Mat toMat(const cv::Rect& roi) const;
+	cv::Mat toMat() const { return toMat(cv::Rect(0, 0, width, height)); }
+
+private:
+	int width = 0, height = 0;
+	int stride = 0; // words per row
+	std::vector<uint64_t> words;
+};
+
+#endif /* BITMASK_H_ */
@@ -0,0 +1,113 @@
+#ifndef CELLARCHIVE_H_
+#define CELLARCHIVE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "cellInfo.hpp"
+#include "mappedFile.hpp"
+
+/*
+* Packed output of the cropped cells.
+* A shard is made of two files:
+*   <base>.pack  encoded crops back to back, append only
+*   <base>.idx   header followed by fixed size records sorted by key,
+*                meant to be mmapped and binary searched
+*/
+
+// One cell of the index: 128 bytes, strings are NUL padded
+struct ArchiveRecord {
+	char key[64];      // getFileName() of the cell
+	uint64_t offset;   // position of the crop in the pack file
+	uint32_t length;   // size of the encoded crop, 0 for a blank cell written without it
+	uint16_t row;
+	uint16_t column;
+	char label[16];
+	char size[8];
+	char scripter[8];
+	char page[16];
+};
+
+struct ArchiveIndexHeader {
+	char magic[8];     // "NICPACK"
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t count;
+};
+
+/*
+* Appends encoded crops to a shard. Thread-safe.
+* The index is kept in memory and written, sorted, by close().
+* Opening an existing shard keeps its cells and appends after them.
+*/
+class ArchiveWriter {
+public:
+	ArchiveWriter();
+	~ArchiveWriter();
+
+	bool open(const std::string& basePath);
+	bool isOpen() const { return pack != NULL; }
+	const std::string& path() const { return basePath; }
+
+	bool append(const CellInfo& cell, const void* data, size_t size);
+	// PNG-encodes image then appends it
+	bool appendImage(const CellInfo& cell, const cv::Mat& image);
+
+	// Drops cells from the index (their bytes stay in the pack), from the next checkpoint
+	void remove(const std::vector<std::string>& keys);
+
+	// Flushes the pack and writes the index of the cells appended so far
+	bool checkpoint();
+
+	// Writes the index, returns false if the shard couldn't be saved
+	bool close();
+
+	size_t count() const;
+
+private:
+	std::string basePath;
+	FILE* pack;
+	uint64_t packSize;
+	std::vector<ArchiveRecord> records;
+	mutable std::mutex mutex;
+	bool failed;
+
+	bool writeIndex();
+
+	ArchiveWriter(const ArchiveWriter&) = delete;
+	ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+};
+
+/*
+* Read access to a shard through memory mappings
+*/
+class ArchiveReader {
+public:
+	bool open(const std::string& basePath);
+	void close();
+
+	size_t size() const { return count; }
+	const ArchiveRecord& record(size_t i) const { return records[i]; }
+
+	// Binary search of a key, NULL when absent
+	const ArchiveRecord* find(const std::string& key) const;
+
+	// Encoded bytes of a cell, they live as long as the reader is open
+	const unsigned char* data(const ArchiveRecord& record) const;
+	cv::Mat decode(const ArchiveRecord& record, int flags = 1) const;
+
+	static CellInfo toCellInfo(const ArchiveRecord& record);
+
+private:
+	MappedFile indexFile;
+	MappedFile packFile;
+	const ArchiveRecord* records = NULL;
+	size_t count = 0;
+};
+
+#endif /* CELLARCHIVE_H_ */
@@ -0,0 +1,33 @@
+#ifndef CELLINFO_H_
+#define CELLINFO_H_
+
+#include <string>
+
+/*
+* Identification of a cropped cell of a form
+*/
+struct CellInfo {
+	std::string label;    // icon of the row
+	std::string size;     // small, medium or large
+	std::string scripter; // scripter number (wNNN)
+	std::string page;     // page number
+	int row = 0;          // from 1
+	int column = 0;       // from 1
+
+	// ink of the cell, see InkStats: inkRatio < 0 when not measured
+	float inkRatio = -1;
+	int inkX = 0, inkY = 0, inkWidth = 0, inkHeight = 0; // bounding box, in the cell
+	float inkCenterX = 0, inkCenterY = 0;
+};
+
+/*
+* Base name of the output files of a cell: iconeID_scripter_page_row_column
+*/
+std::string getFileName(const CellInfo& cell);
+
+/*
+* Content of the .txt metadata file of a cell
+*/
+std::string getMetadataText(const CellInfo& cell);
+
+#endif /* CELLINFO_H_ */
@@ -0,0 +1,42 @@
+#ifndef CELLOUTPUT_H_
+#define CELLOUTPUT_H_
+
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "asyncWriter.hpp"
+#include "cellArchive.hpp"
+#include "cellInfo.hpp"
+#include "manifestWriter.hpp"
+
+/*
+* Writes the crops of a run in its output layout:
+* archive shard when archive is open, otherwise png files with their
+* metadata in the manifest when it is open, or in a .txt per cell.
+* The crops are encoded and written by the AsyncWriter.
+*/
+class CellOutput {
+public:
+	CellOutput(AsyncWriter& writer, ArchiveWriter& archive, ManifestWriter& manifest, const std::string& prefix);
+
+	// Submits a crop, which may be a ROI of the page: a ROI is copied, so the page
+	// can be released or reused as soon as write returns. Returns the png file or
+	// the key of the cell in the archive, appends every file written to outputs,
+	// a cell of the archive as <archive base>#<key>.
+	std::string write(const CellInfo& cell, const cv::Mat& crop, std::vector<std::string>& outputs);
+	// Metadata of a cell without its crop (blank cell): manifest row with an empty
+	// output, .txt file alone, or archive record of length 0
+	void writeBlank(const CellInfo& cell, std::vector<std::string>& outputs);
+
+	bool isArchive() const { return archive.isOpen(); }
+
+private:
+	AsyncWriter& writer;
+	ArchiveWriter& archive;
+	ManifestWriter& manifest;
+	std::string prefix; // output directory
+};
+
+#endif /* CELLOUTPUT_H_ */
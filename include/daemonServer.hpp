@@ -0,0 +1,64 @@
+#ifndef DAEMONSERVER_H_
+#define DAEMONSERVER_H_
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Unix domain socket server of the daemon mode.
+* Messages in both directions are a 4 byte big endian length followed by
+* the payload. A client sends requests on its connection and gets one
+* response per request, in order.
+* Not available on Windows.
+*/
+class DaemonServer {
+public:
+	typedef std::function<std::string(const std::string&)> Handler;
+
+	DaemonServer();
+	~DaemonServer();
+
+	// Binds the socket (an existing socket file is replaced)
+	bool listen(const std::string& path);
+
+	// Serves each connection on its own thread until SIGINT or SIGTERM.
+	// The threads of closed connections are joined as the server goes.
+	void serve(const Handler& handler);
+
+	// largest request accepted, a page path
+	static const size_t maxRequestBytes = 64 << 10;
+
+	// Client side
+	static int connectTo(const std::string& path);
+	static bool sendMessage(int fd, const std::string& payload);
+	// false on a closed connection or a message over maxBytes (not read)
+	static bool receiveMessage(int fd, std::string& payload, size_t maxBytes = 64 << 20);
+	static void closeSocket(int fd);
+
+private:
+	std::string socketPath;
+	int listenFd;
+
+	struct Connection {
+		std::thread thread;
+		bool finished = false; // the thread is about to return
+	};
+
+	std::mutex clientsMutex;
+	std::set<int> clients;
+	std::list<Connection> connections;
+
+	void serveConnection(int fd, const Handler& handler, Connection* connection);
+	// joins the threads of the finished connections
+	void reapConnections();
+
+	DaemonServer(const DaemonServer&) = delete;
+	DaemonServer& operator=(const DaemonServer&) = delete;
+};
+
+#endif /* DAEMONSERVER_H_ */
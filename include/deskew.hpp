@@ -0,0 +1,19 @@
+#ifndef DESKEW_H_
+#define DESKEW_H_
+
+#include "opencv2/core/core.hpp"
+
+/*
+* Skew of a scanned page, measured on a binarized copy reduced by proxyScale:
+* the angle whose projection profile of the dark pixels (rows of the grid
+* and of the text) is the sharpest, searched in [-maxAngle, maxAngle]
+* degrees by steps of 0.25 then refined by steps of 0.025.
+* Returns the angle, in degrees, for getRotationMatrix2D around the center
+* of the page to straighten it; 0 when there is nothing to measure.
+*/
+double estimateSkew(const cv::Mat& page, double maxAngle = 5, double proxyScale = 0.125);
+
+// rotation of the page around its center straightening a skew of angle degrees
+cv::Mat straighteningTransform(const cv::Size& pageSize, double angle);
+
+#endif /* DESKEW_H_ */
@@ -0,0 +1,97 @@
+#ifndef DETECTIONCONFIG_H_
+#define DETECTIONCONFIG_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cv { class CommandLineParser; }
+
+// One findSquares pass: a color plane thresholded at one level
+struct DetectionPass {
+	int channel;
+	int level;
+};
+
+/*
+* Detection and classification parameters of a PageProcessor.
+* Saved and loaded with cv::FileStorage (.yml, .xml or .json), the keys
+* are the names of the members; missing keys keep their default value.
+*/
+struct DetectionConfig {
+	std::string engine = "contours"; // square detection engine
+
+	// findSquares
+	int thresh = 50;   // upper threshold of Canny
+	int levels = 5;    // threshold levels per color plane, level 0 is Canny
+	// passes to run, all the channels and levels when empty
+	std::vector<DetectionPass> passes;
+	double minContourArea = 1000; // of a quad, in pixels
+	// threshold levels chosen on the histogram of each page (selectPassesFromHistogram)
+	bool adaptiveLevels = false;
+	double minSeparability = 0.6; // Otsu criterion under which every level runs
+	int minAdaptiveQuads = 20;    // fewer quads found: every pass runs
+
+	// grid engines (tree...): a grid has minGridCells cells at least, its cells are
+	// within gridRegularity (a fraction) of their median width and height
+	int minGridCells = 3;
+	double gridRegularity = 0.25;
+	// components and runs engines: largest width/height (or height/width) ratio of a cell,
+	// smallest part of its bounding box left blank by the writing
+	double maxCellAspect = 1.5, minCellFill = 0.5;
+	// lines engine: shortest printed line, in pixels, and part of the longest
+	// line (and of a cell side) a line must cover
+	double minLineLength = 150, minLineCoverage = 0.5;
+
+	// filters
+	double minSquareWidth = 15.5, maxSquareWidth = 17;
+	float overlapTolX = 160, overlapTolY = 320;
+	float rowTolerance = 160;
+
+	// zone of the icon at the left of a row
+	int iconZoneWidth = 600, iconZoneHeight = 350;
+	// symbol cache: an icon zone within symbolCacheDistance bits of a cached one (dHash)
+	// takes its label, one hit out of symbolVerifyEvery is classified again (0: never)
+	int symbolCacheDistance = 6, symbolVerifyEvery = 20;
+
+	// the pixel sizes above are for cells of referenceCellSide pixels;
+	// with estimateScale they follow the cell size measured on each page
+	bool estimateScale = false;
+	double referenceCellSide = 265;
+	// findSquares runs on the page resized by this factor (0.5: half resolution)
+	double detectionScale = 1;
+
+	// straighten the pages skewed by more than skewThreshold degrees (up to maxSkew)
+	bool deskew = false;
+	double skewThreshold = 0.2, maxSkew = 5;
+
+	// ink statistics of the cells, inkMargin of each side of a cell is left out (grid lines)
+	bool inkStats = false;
+	double inkMargin = 0.1;
+	// cells with a lower ink ratio get their metadata but no crop, 0 writes them all
+	double minInkRatio = 0;
+
+	bool measuresInk() const { return inkStats || minInkRatio > 0; }
+
+	// same configuration for cells factor times as large
+	DetectionConfig scaled(double factor) const;
+
+	// passes, or every channel and level, ordered by channel then level
+	std::vector<DetectionPass> activePasses() const;
+
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	// changes with every parameter that changes the layout of a page (engine, passes,
+	// detection, filters, icon zone, scale and deskew)
+	uint64_t detectionHash() const;
+	// changes with every other parameter that changes the cells written
+	// (symbol cache, ink statistics, blank cells)
+	uint64_t classificationHash() const;
+};
+
+// Loads the file of the "config" key of parser into config, if any.
+// False, with a message, when it can't be loaded.
+bool loadConfigOption(const cv::CommandLineParser& parser, DetectionConfig& config);
+
+#endif /* DETECTIONCONFIG_H_ */
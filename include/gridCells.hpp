@@ -0,0 +1,37 @@
+#ifndef GRIDCELLS_H_
+#define GRIDCELLS_H_
+
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "pipeline.hpp"
+#include "runLengthMask.hpp"
+
+/*
+* Helpers of the detection engines reading the grid of the form as a whole
+* (tree, components, lines) rather than quad by quad.
+*/
+
+// the printed lines and the ink in white (255) on black: Otsu threshold of the gray page
+void binarizeInk(const cv::Mat& image, cv::Mat& ink);
+// same ink as runs, encoded by the threshold loop (no mask is written)
+RunLengthMask binarizeInkRuns(const cv::Mat& image);
+
+// axis aligned square of a rectangle, upper left corner first, clockwise
+square_t rectSquare(const cv::Rect& rect);
+
+// keeps the squares whose bounding box is within regularity (a fraction)
+// of the median width and height of squares
+void keepRegularCells(std::vector<square_t>& squares, double regularity);
+
+// morphological opening of a binary mask by a line of length pixels, horizontal or
+// vertical: keeps the lines at least that long. van Herk/Gil-Werman erosion then dilation,
+// cost independent of length.
+void openLines(const cv::Mat& binary, cv::Mat& lines, int length, bool horizontal);
+
+// sorts squares by row then column; two squares are on the same row when
+// their tops are closer than half the median height
+void sortCellsByRow(std::vector<square_t>& squares);
+
+#endif /* GRIDCELLS_H_ */
@@ -0,0 +1,31 @@
+#ifndef HASHING_H_
+#define HASHING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "opencv2/core/core.hpp"
+
+/*
+* 64 bit FNV-1a, chainable through the hash parameter
+*/
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// hash of the size, type and pixels of an image (ROIs included)
+inline uint64_t hashImage(const cv::Mat& image, uint64_t hash = 14695981039346656037ULL) {
+	int header[] = { image.rows, image.cols, image.type() };
+	hash = fnv1a64(header, sizeof(header), hash);
+	for (int r = 0; r < image.rows; r++) {
+		hash = fnv1a64(image.ptr(r), image.cols * image.elemSize(), hash);
+	}
+	return hash;
+}
+
+#endif /* HASHING_H_ */
@@ -1,7 +1,9 @@
 #ifndef HISTOGRAM_H_
 #define HISTOGRAM_H_
 
+#include <cstdint>
 #include <iostream>
+#include <vector>
 using namespace std;
 
 #include "opencv2/imgproc.hpp"
@@ -9,9 +11,54 @@ using namespace std;
 using namespace cv;
 
 /*
-* Compute and show histogram of a gray OR color BGR image
+* Bin counts of each channel of an 8 bit image: counts[c][b] pixels of
+* channel c fall in bin b, the bins split [0, 255] in equal parts.
 */
-void computeHistogram(const string& histTitle,const Mat& img);
+struct ChannelHistograms {
+	int bins = 0;
+	vector<vector<uint32_t>> counts;
 
+	int channels() const { return (int)counts.size(); }
+};
 
-#endif /* HISTOGRAM_H_ */
\ No newline at end of file
+/*
+* Histograms of every channel of img (CV_8U, 1 to 4 channels) in one pass
+* over the interleaved pixels, without split. The rows are shared between
+* threads, each one fills its own partial histograms which are merged at the end.
+* No side effect.
+*/
+ChannelHistograms computeChannelHistograms(const Mat& img, int bins = 256);
+
+/*
+* Histograms of the HSV conversion of a BGR image (CV_8UC3), same values as
+* cvtColor(COLOR_BGR2HSV) then computeChannelHistograms, but each pixel is
+* converted in registers and counted at once: the image is read once and no
+* HSV image is written. The overload filling hist allocates nothing once
+* hist has been filled with the same number of bins.
+*/
+ChannelHistograms computeHsvHistograms(const Mat& bgr, int bins = 256);
+void computeHsvHistograms(const Mat& bgr, ChannelHistograms& hist, int bins = 256);
+
+// adds the counts of hist to total, which takes its shape when empty
+void addHistograms(ChannelHistograms& total, const ChannelHistograms& hist);
+
+/*
+* Otsu threshold of a histogram: first bin of the upper class. separability,
+* if any, receives the between class variance over the total variance, from
+* 0 to 1: close to 1 for two well separated modes (ink and paper).
+*/
+int otsuThreshold(const vector<uint32_t>& counts, double* separability = NULL);
+
+/*
+* Plot of the histograms, one curve per channel: blue, green, red (white
+* for a single channel)
+*/
+Mat plotHistograms(const ChannelHistograms& hist, int width = 1000, int height = 600);
+
+/*
+* Compute and show histogram of the HSV conversion of a BGR image
+*/
+void computeHistogram(const string& histTitle, const Mat& img);
+
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,41 @@
+#ifndef INKSTATS_H_
+#define INKSTATS_H_
+
+#include <cstdint>
+
+#include "opencv2/core/core.hpp"
+
+// Ink of a cell, coordinates from the upper left corner of the cell
+struct InkStats {
+	double ratio = -1;  // ink pixels / pixels, < 0 when not measured
+	cv::Rect box;       // bounding box of the ink, empty without ink
+	cv::Point2f center; // centre of mass of the ink
+
+	bool measured() const { return ratio >= 0; }
+};
+
+/*
+* Integral images of the ink of a zone of a page (pixels darker than the
+* Otsu threshold of the zone): ink count and ink weighted x and y.
+* The ratio and the centre of mass of any rectangle cost 4 lookups per
+* image, its ink bounding box binary searches on the count.
+* Sums are kept modulo 2^32: a rectangle sum is exact as long as it fits in
+* 32 bits, i.e. for cells up to about 1000 x 1000 pixels.
+*/
+class InkIntegral {
+public:
+	// area: zone of image to integrate, the rectangles asked must lie in it
+	InkIntegral(const cv::Mat& image, const cv::Rect& area);
+
+	// margin: fraction of the width and of the height left out on every
+	// side of rect, so that the lines of the grid don't count as ink
+	InkStats cellStats(const cv::Rect& rect, double margin = 0.1) const;
+
+private:
+	cv::Rect area;
+	cv::Mat count, sumX, sumY; // (rows + 1) x (cols + 1), uint32 stored as CV_32S
+
+	uint32_t rectSum(const cv::Mat& integral, int x, int y, int width, int height) const;
+};
+
+#endif /* INKSTATS_H_ */
@@ -0,0 +1,57 @@
+#ifndef IORING_H_
+#define IORING_H_
+
+#include <cstddef>
+#include <vector>
+
+/*
+* Batched file creation through io_uring (Linux, built when CMake finds
+* linux/io_uring.h). The files of a batch are opened with one submission,
+* then written and closed with a second one. Elsewhere, or when the kernel
+* refuses the ring (old kernel, seccomp), available() is false and the
+* callers write the files themselves.
+* One ring per thread: not thread-safe.
+*/
+class IoRing {
+public:
+	struct FileWrite {
+		const char* path;
+		const void* data;
+		size_t size;
+		int result; // set by writeFiles: size on success, -errno on failure
+	};
+
+	explicit IoRing(unsigned entries = 64);
+	~IoRing();
+
+	bool available() const { return ringFd >= 0; }
+
+	// Creates (or truncates), writes and closes every file of writes.
+	// Returns false without touching the results when the ring can't run
+	// these operations; the ring is then no longer available.
+	bool writeFiles(std::vector<FileWrite>& writes);
+
+private:
+	// same layout with or without SQUARES_IO_URING (a definition of squares_lib only)
+	int ringFd;
+	unsigned entries;
+	void* sqRing;
+	void* cqRing;
+	size_t sqRingSize, cqRingSize;
+	void* sqes;
+	size_t sqesSize;
+	unsigned *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	void* cqes;
+
+	void close();
+	// prepared entries are submitted, then count completions are reaped
+	// into results (indexed by user data)
+	bool submitAndWait(unsigned submitted, unsigned count, std::vector<int>& results);
+	void* nextEntry(unsigned& tail);
+
+	IoRing(const IoRing&) = delete;
+	IoRing& operator=(const IoRing&) = delete;
+};
+
+#endif /* IORING_H_ */
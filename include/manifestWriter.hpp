@@ -0,0 +1,79 @@
+#ifndef MANIFESTWRITER_H_
+#define MANIFESTWRITER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cellInfo.hpp"
+
+/*
+* Single metadata file of a run, one row per cell (CSV or JSON Lines),
+* replacing the .txt file written next to every crop.
+* Rows are formatted into a buffer of the calling thread; a buffer goes to
+* the file in one write once it holds flushBytes. Every checkpointRows rows
+* all the buffers are written and the file is fsynced.
+* The file is append only: when the journal redoes a changed page, its new
+* rows follow the rows of the former runs. Consumers keep the last row of
+* each (form, row, column).
+*/
+class ManifestWriter {
+public:
+	enum Format { CSV, JSON_LINES };
+
+	ManifestWriter(size_t flushBytes = 1 << 20, uint64_t checkpointRows = 10000);
+	~ManifestWriter();
+
+	// Appends to path (the CSV header is written to a new file), after the
+	// rows of the former runs, which are left as they are. Fails when the
+	// header of an existing CSV file has other columns (with or without ink).
+	// inkColumns: the CSV rows end with the ink statistics of the cells
+	bool open(const std::string& path, Format format, bool inkColumns = false);
+	bool isOpen() const { return file != NULL; }
+
+	// Thread-safe
+	void addRow(const CellInfo& cell, const std::string& output);
+
+	// Writes the buffers of every thread and syncs the file to disk
+	bool checkpoint();
+	bool close();
+
+	uint64_t rows() const { return rowCount; }
+
+	// JSON_LINES for .jsonl/.json, CSV otherwise
+	static Format formatFromPath(const std::string& path);
+
+private:
+	struct LocalBuffer {
+		std::mutex mutex;
+		std::string data;
+	};
+
+	const size_t flushBytes;
+	const uint64_t checkpointRows;
+	const uint64_t id; // tells the writers apart in the thread local caches
+
+	Format format;
+	bool inkColumns;
+	FILE* file;
+	std::mutex fileMutex;
+	bool failed;
+
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<LocalBuffer> > buffers;
+
+	std::atomic<uint64_t> rowCount;
+
+	LocalBuffer& localBuffer();
+	void formatRow(std::string& out, const CellInfo& cell, const std::string& output) const;
+	void writeOut(std::string& data);
+
+	ManifestWriter(const ManifestWriter&) = delete;
+	ManifestWriter& operator=(const ManifestWriter&) = delete;
+};
+
+#endif /* MANIFESTWRITER_H_ */
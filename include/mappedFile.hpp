@@ -0,0 +1,38 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+/*
+* Read-only memory mapping of a whole file (mmap or MapViewOfFile)
+*/
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return opened; }
+
+	// Asks the kernel to start reading the whole mapping (no-op on Windows)
+	void willNeed() const;
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	bool opened;
+	const unsigned char* bytes;
+	size_t length;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
+
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,58 @@
+#ifndef PAGELOADER_H_
+#define PAGELOADER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+/*
+* A decoded input page and the time spent to get it
+*/
+struct LoadedPage {
+	std::string path;
+	cv::Mat image;
+	double ioWaitMs = 0;  // waiting for the bytes of the file
+	double decodeMs = 0;  // imdecode
+	uint64_t contentHash = 0; // fnv1a64 of the file, if requested
+	// of the file before it was read (for the run journal), 0 when it can't be read
+	uint64_t fileSize = 0;
+	int64_t modificationTime = 0;
+};
+
+/*
+* Loads the pages of a work queue in order. Each PNG is mapped in memory and
+* decoded from the mapping without copy, while the kernel is asked to read
+* the next readAhead files (posix_fadvise WILLNEED) so that the disk works
+* during the processing of the current page.
+*/
+class PageLoader {
+public:
+	PageLoader(const std::vector<std::string>& paths, int readAhead = 4);
+
+	// Loads the next page, false at the end of the queue.
+	// A page that can't be read is returned with an empty image.
+	bool next(LoadedPage& page);
+
+	size_t size() const { return paths.size(); }
+
+	// Hashes the bytes of each file (for the run journal)
+	void setHashContent(bool enabled) { hashContent = enabled; }
+
+	// Pages of an input: a .png, a .txt listing one page per line
+	// or a directory (its *.png)
+	static std::vector<std::string> listInputs(const std::string& input);
+
+	// Starts reading a file in the page cache, returns immediately
+	static void adviseWillNeed(const std::string& path);
+
+private:
+	std::vector<std::string> paths;
+	size_t position;
+	size_t advised; // files up to this index were already advised
+	int readAhead;
+	bool hashContent;
+};
+
+#endif /* PAGELOADER_H_ */
@@ -0,0 +1,71 @@
+#ifndef PAGEPROCESSOR_H_
+#define PAGEPROCESSOR_H_
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "detectionConfig.hpp"
+#include "pipeline.hpp"
+#include "symbolCache.hpp"
+#include "templateBank.hpp"
+
+/*
+* Entry point of the library: cells of a page and labels of their rows.
+* A PageProcessor holds its configuration, its template bank and its symbol
+* cache, there is no global state: several processors may live in one
+* process and process() may be called from several threads at once.
+*/
+
+struct PageCells {
+	PageLayout layout;
+	std::vector<std::vector<square_t>> rows; // squares grouped by row, empty for reclassify()
+	std::vector<DetectedCell> cells;
+	PageStrip strip; // straightened band of a skewed page
+
+	// image of a cell, page is the image given to process()
+	cv::Mat crop(const cv::Mat& page, const cv::Rect& rect) const { return cropCell(page, strip, rect); }
+};
+
+class PageProcessor {
+public:
+	// cacheSymbols: reuse the labels of similar icon zones (see SymbolCache)
+	PageProcessor(const DetectionConfig& config, std::shared_ptr<const TemplateBank> templates, bool cacheSymbols = true);
+
+	// false when the engine of the configuration is unknown
+	bool isValid() const { return (bool)detect; }
+
+	PageCells process(const cv::Mat& image) const;
+	// cells of a page whose layout is known (from the run journal): only its rows are labelled
+	PageCells reclassify(const cv::Mat& image, const PageLayout& layout) const;
+
+	const DetectionConfig& config() const { return configuration; }
+	const TemplateBank& templates() const { return *bank; }
+
+	// hash of what gives the layout of a page: the detection configuration
+	uint64_t detectionHash() const { return configuration.detectionHash(); }
+	// hash of what gives the labels and ink of the cells of a layout:
+	// the rest of the configuration and the templates
+	uint64_t classificationHash() const;
+
+	SymbolCache::Stats cacheStats() const { return cache.stats(); }
+	void printStats(std::ostream& out) const { cache.printStats(out); }
+
+private:
+	DetectionConfig configuration;
+	std::shared_ptr<const TemplateBank> bank;
+	SquareDetector detect;
+	bool cacheSymbols;
+	mutable SymbolCache cache;
+
+	// labels and ink statistics of the cells of result.layout
+	void classify(const cv::Mat& image, PageCells& result) const;
+
+	PageProcessor(const PageProcessor&) = delete;
+	PageProcessor& operator=(const PageProcessor&) = delete;
+};
+
+#endif /* PAGEPROCESSOR_H_ */
@@ -0,0 +1,77 @@
+#ifndef PAGESTREAM_H_
+#define PAGESTREAM_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Source of the pages to process, delivered by micro-batches:
+* - a fixed list, delivered as one batch
+* - page paths read from stdin, one per line, until end of file
+* - a spool directory: the pages already there, then each PNG written or
+*   moved into it (inotify on Linux, polling elsewhere), without end
+*/
+class PageStream {
+public:
+	PageStream();
+	~PageStream();
+
+	void setPages(const std::vector<std::string>& pages);
+	void readStdin();
+	bool watchDirectory(const std::string& directory);
+
+	// Waits for a page, then gathers the pages arriving within windowMs
+	// (at most maxBatch). False once the stream is over.
+	bool nextBatch(std::vector<std::string>& batch, int windowMs, size_t maxBatch);
+
+	bool isStreaming() const { return streaming; }
+
+	// The page of a batch is done (or given up): a spool page of that path
+	// may come again. Until then it is queued once, however often it is seen;
+	// a page closed or moved into the spool meanwhile is queued again at once.
+	void pageDone(const std::string& page);
+	// The page of a batch couldn't be decoded (maybe still being written): it is
+	// queued again when written again, or by the next scan when polling.
+	// True when it failed maxAttempts times in a row and is given up.
+	bool pageFailed(const std::string& page);
+
+	static const int maxAttempts = 3;
+
+private:
+	// shared with the reading thread, which may outlive the stream (blocked on stdin)
+	struct State {
+		std::mutex mutex;
+		std::condition_variable arrived;
+		std::deque<std::string> queue;
+		std::set<std::string> pending; // spool pages queued or being processed
+		std::set<std::string> rewritten; // pending pages written again since they were queued
+		std::set<std::string> scanned; // pages found by the scans, queued once each
+		std::map<std::string, int> failures; // failed attempts in a row
+		bool finished = false;
+		bool stopping = false;
+	};
+
+	std::shared_ptr<State> state;
+	std::thread watcher;
+	bool streaming;
+
+	static void push(State& state, const std::string& page);
+	// push unless page is pending; written: from an event, the page has new content
+	static void pushNew(State& state, const std::string& page, bool written);
+	// called with the mutex held
+	static bool queueLocked(State& state, const std::string& page);
+	static void finish(State& state);
+	static void watchLoop(std::shared_ptr<State> state, std::string directory);
+
+	PageStream(const PageStream&) = delete;
+	PageStream& operator=(const PageStream&) = delete;
+};
+
+#endif /* PAGESTREAM_H_ */
@@ -0,0 +1,183 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "detectionConfig.hpp"
+#include "inkStats.hpp"
+#include "symbolCache.hpp"
+
+/*
+* Stages of the processing of a page:
+* findSquares -> [estimateSkew] -> [estimateCellScale] -> filterBySize -> rotateSquares -> filterOverlappingSquares
+* -> groupByRow, then whatSymbols (TemplateBank) on the icon zone of each row.
+* The stages have no state: they can run on several pages at once.
+*/
+
+typedef std::vector<cv::Point> square_t;
+
+// returns sequence of squares detected on the image:
+// findSquaresInPlane for each pass of the configuration. With config.adaptiveLevels,
+// only the passes of selectPassesFromHistogram, then the others when fewer than
+// config.minAdaptiveQuads squares were found
+void findSquares(const cv::Mat& image, std::vector<square_t>& squares, const DetectionConfig& config);
+
+// passes of the configuration for this page: on each channel, Canny and the one or
+// two threshold levels closest to the Otsu threshold of the histogram of the channel,
+// every level when the histogram isn't bimodal enough (config.minSeparability)
+std::vector<DetectionPass> selectPassesFromHistogram(const cv::Mat& image, const DetectionConfig& config);
+
+// color plane c of image into plane (CV_8U, same size)
+void extractPlane(const cv::Mat& image, int c, cv::Mat& plane);
+
+// one pass of findSquares: level 0 is Canny, level l thresholds at (l + 1) * 255 / levels.
+// Appends the squares found to squares.
+void findSquaresInPlane(const cv::Mat& plane, int level, std::vector<square_t>& squares, const DetectionConfig& config);
+// threshold of level l > 0: (l + 1) * 255 / levels
+int levelThreshold(int level, int levels);
+// the quads of a binary mask (CV_8U): second half of findSquaresInPlane
+void findSquaresInMask(const cv::Mat& binary, std::vector<square_t>& squares, const DetectionConfig& config);
+
+void filterBySize(std::vector<square_t>& in, std::vector<square_t>& out, double minWidth, double maxWidth);
+
+// rotate each square so that the upper left corner is the first cv::Point
+void rotateSquares(std::vector<square_t>& squaresBis);
+
+bool squaresOverlap(square_t& a, square_t& b, float tolX, float tolY);
+void filterOverlappingSquares(std::vector<square_t>& in, std::vector<square_t>& out, float tolX, float tolY);
+
+bool areSameRow(square_t a, square_t b, float tolY);
+// squares must not be empty
+std::vector<std::vector<square_t>> groupByRow(std::vector<square_t>& squares, float tolY);
+
+/*
+* Size of the cells of a page: mode of the histogram of the quad sides,
+* refined by the median of the sides around it. scale = side / referenceSide.
+* found is false with fewer than minSamples quads around the mode.
+*/
+struct CellScale {
+	bool found = false;
+	double side = 0;
+	double scale = 1;
+	int samples = 0;
+};
+
+CellScale estimateCellScale(const std::vector<square_t>& squares, double referenceSide, int minSamples = 4);
+
+// largest cosine of the angles of a quad, 0 for a rectangle
+double maxQuadCosine(const square_t& quad);
+
+/*
+* Square detection engines, interchangeable first stage of the pipeline.
+* "contours" is findSquares, "tree" findGridCellsTree, "components"
+* findGridCellsComponents, "runs" findGridCellsRuns, "lines" findGridCellsLines.
+*/
+typedef std::function<void(const cv::Mat&, std::vector<square_t>&, const DetectionConfig&)> SquareDetector;
+
+// empty function when engine is unknown
+SquareDetector findSquareDetector(const std::string& engine);
+std::vector<std::string> squareDetectorNames();
+
+// true when engine finds each cell once, by row then by column:
+// detectCells then skips the filters and groupByRow
+bool squareDetectorOrdersCells(const std::string& engine);
+
+/*
+* Cells of the grids of a page from a single contour tree (RETR_TREE) of the
+* binarized page: a grid is a contour whose children are mostly quads, its
+* cells are those children of regular size (within config.gridRegularity of
+* their median width and height). Squares by row then column.
+*/
+void findGridCellsTree(const cv::Mat& image, std::vector<square_t>& squares, const DetectionConfig& config);
+
+/*
+* Cells of the grids of a page from one labelling of the paper regions of
+* the binarized page (connectedComponentsWithStats): regions not touching
+* the border, larger than config.minContourArea, with a width/height ratio
+* under config.maxCellAspect and a fill ratio of their bounding box over
+* config.minCellFill, then of regular size. Squares by row then column.
+*/
+void findGridCellsComponents(const cv::Mat& image, std::vector<square_t>& squares, const DetectionConfig& config);
+
+/*
+* Same cells as findGridCellsComponents, the page being binarized straight
+* into runs (RunLengthMask) and the paper regions labelled on the runs.
+*/
+void findGridCellsRuns(const cv::Mat& image, std::vector<square_t>& squares, const DetectionConfig& config);
+
+/*
+* Cells of the ruled grid of a page from its lines: openings of the binarized
+* page by horizontal and vertical lines of config.minLineLength pixels, lines
+* where the row (column) projections of these masks reach config.minLineCoverage
+* of their maximum, and a cell between two consecutive lines each way when
+* its four sides are covered as much. Squares by row then column.
+*/
+void findGridCellsLines(const cv::Mat& image, std::vector<square_t>& squares, const DetectionConfig& config);
+
+struct DetectedCell {
+	int row;      // from 1
+	int column;   // from 1
+	cv::Rect rect;
+	SymbolLabel label; // of the row
+	InkStats ink;      // measured by PageProcessor with config.measuresInk()
+};
+
+/*
+* Straightened part of a skewed page. The cells are then in the frame of the
+* page rotated by angle around its center; image is the band of that frame
+* holding the rows, origin its upper left corner. Empty image: the cells are
+* in the frame of the page.
+*/
+struct PageStrip {
+	double angle = 0; // degrees
+	cv::Point origin;
+	cv::Mat image;
+};
+
+// crop of rect, a cell or an icon zone, from the page or from its straightened strip
+cv::Mat cropCell(const cv::Mat& page, const PageStrip& strip, const cv::Rect& rect);
+
+/*
+* Geometry of the cells of a page, before their rows are labelled: the icon
+* zone and the cells of each row, in the frame of the page rotated by angle
+* (0: the page isn't straightened). The run journal keeps it, so that the rows
+* of a page can be labelled again without detecting its cells.
+*/
+struct PageLayout {
+	double angle = 0; // degrees
+	std::vector<cv::Rect> iconZones;          // one per row
+	std::vector<std::vector<cv::Rect>> cells; // of each row
+
+	// single line: the angle and the number of rows, then for each row its icon zone,
+	// its number of cells and their rects, separated by spaces
+	std::string toString() const;
+	// false when text isn't a layout
+	static bool fromString(const std::string& text, PageLayout& layout);
+};
+
+// label of the icon zone of row (from 0)
+typedef std::function<SymbolLabel(int row, const cv::Mat& iconZone)> RowClassifier;
+
+// Cells of a page: locateCells then classifyCells.
+std::vector<DetectedCell> detectCells(const cv::Mat& image, const DetectionConfig& config, const SquareDetector& detect,
+	const RowClassifier& classify, std::vector<std::vector<square_t>>* rows = NULL, PageStrip* strip = NULL);
+
+// Layout of a page: detect, then the filters and groupByRow.
+// detect runs on the page resized by config.detectionScale, the cells are in page pixels.
+// With config.estimateScale the filters follow the cell size measured on the page.
+// With config.deskew the angle of a skewed page is measured, the cells are in its straightened frame.
+// rows, if any, receives the squares grouped by row.
+PageLayout locateCells(const cv::Mat& image, const DetectionConfig& config, const SquareDetector& detect,
+	std::vector<std::vector<square_t>>* rows = NULL);
+
+// Cells of a layout labelled by classify, row by row. The band of the page holding
+// the rows is straightened into strip when layout.angle isn't 0, the cells are then
+// cropped from strip.
+std::vector<DetectedCell> classifyCells(const cv::Mat& image, const PageLayout& layout, const RowClassifier& classify,
+	PageStrip* strip = NULL);
+
+#endif /* PIPELINE_H_ */
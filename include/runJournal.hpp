@@ -0,0 +1,74 @@
+#ifndef RUNJOURNAL_H_
+#define RUNJOURNAL_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+* Journal of the pages done by previous runs, so that a run can be resumed
+* or redone incrementally.
+* Each entry holds the input page (size, modification time and content hash),
+* the hashes of the configuration it was processed with, its outputs and its
+* layout (PageLayout::toString): a page whose detection configuration didn't
+* change only has its rows labelled again.
+* The file is a list of tab separated lines, a later line of a page
+* replacing an earlier one.
+*/
+class RunJournal {
+public:
+	struct Entry {
+		uint64_t fileSize = 0;
+		int64_t modificationTime = 0;
+		uint64_t contentHash = 0;
+		uint64_t detectionHash = 0;
+		uint64_t classificationHash = 0;
+		std::vector<std::string> outputs;
+		std::string layout;
+	};
+
+	enum Status {
+		TODO,       // not done, or its content or detection configuration changed
+		RECLASSIFY, // same content and layout: only its cells are labelled and written again
+		DONE        // same content and configuration
+	};
+
+	RunJournal();
+	~RunJournal();
+
+	// Loads the journal then opens it for appending
+	bool open(const std::string& path);
+	bool isOpen() const { return file != NULL; }
+
+	// What remains to do on a page for these hashes of the configuration.
+	// The content is only hashed when the size or time of the file changed.
+	Status status(const std::string& page, uint64_t detectionHash, uint64_t classificationHash) const;
+
+	// Entry of a page, NULL when it was never done
+	const Entry* find(const std::string& page) const;
+
+	// Records a page, written by the next commit(). The size, time and hash of
+	// the entry are those of the file when it was read, not when it is marked.
+	void markDone(const std::string& page, const Entry& entry);
+
+	// Appends the marked pages to the file; to call once their outputs are on disk
+	bool commit();
+
+	size_t size() const { return entries.size(); }
+
+	static uint64_t hashFile(const std::string& path);
+
+private:
+	std::unordered_map<std::string, Entry> entries;
+	std::vector<std::pair<std::string, Entry> > pending;
+	FILE* file;
+
+	static bool fileStatus(const std::string& path, uint64_t& size, int64_t& modificationTime);
+
+	RunJournal(const RunJournal&) = delete;
+	RunJournal& operator=(const RunJournal&) = delete;
+};
+
+#endif /* RUNJOURNAL_H_ */
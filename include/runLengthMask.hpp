@@ -0,0 +1,69 @@
+#ifndef RUNLENGTHMASK_H_
+#define RUNLENGTHMASK_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+/*
+* Binary page stored as runs of foreground pixels, row by row.
+* A ruled form with handwriting is mostly long runs: a few hundred kB
+* instead of one byte per pixel, so many pages stay resident per worker.
+* The queries work on the runs, without unpacking the pixels.
+*/
+class RunLengthMask {
+public:
+	// foreground pixels [start, end) of a row
+	struct Run {
+		int32_t start, end;
+	};
+
+	struct Component {
+		cv::Rect box;
+		int64_t area; // pixels
+	};
+
+	RunLengthMask() {}
+
+	// foreground: plane >= threshold, or plane < threshold when below;
+	// the runs are emitted by the threshold loop, no mask is written
+	static RunLengthMask fromThreshold(const cv::Mat& plane, int threshold, bool below = false);
+	// foreground: non zero pixels of a CV_8U mask
+	static RunLengthMask fromMask(const cv::Mat& mask);
+
+	int rows() const { return height; }
+	int cols() const { return width; }
+	size_t runCount() const { return runs.size(); }
+	size_t bytes() const { return runs.size() * sizeof(Run) + rowOffsets.size() * sizeof(uint32_t); }
+
+	const Run* rowBegin(int y) const { return runs.data() + rowOffsets[y]; }
+	const Run* rowEnd(int y) const { return runs.data() + rowOffsets[y + 1]; }
+
+	// background runs of the same page
+	RunLengthMask inverted() const;
+
+	// foreground pixels per row, per column
+	std::vector<int> rowProjection() const;
+	std::vector<int> columnProjection() const;
+
+	// foreground pixels in roi, and their bounding box (empty without any)
+	int64_t count(const cv::Rect& roi) const;
+	cv::Rect boundingBox(const cv::Rect& roi) const;
+	cv::Rect boundingBox() const { return boundingBox(cv::Rect(0, 0, width, height)); }
+
+	// connected components of the foreground, by union of the runs
+	// overlapping from one row to the next
+	std::vector<Component> components(bool eightConnected = false) const;
+
+	// 0/255 CV_8U image of roi, for the consumers needing pixels
+	cv::Mat toMat(const cv::Rect& roi) const;
+	cv::Mat toMat() const { return toMat(cv::Rect(0, 0, width, height)); }
+
+private:
+	int width = 0, height = 0;
+	std::vector<Run> runs;
+	std::vector<uint32_t> rowOffsets; // runs of row y: [rowOffsets[y], rowOffsets[y + 1])
+};
+
+#endif /* RUNLENGTHMASK_H_ */
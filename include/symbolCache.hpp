@@ -0,0 +1,74 @@
+#ifndef SYMBOLCACHE_H_
+#define SYMBOLCACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+/*
+* Result of the classification of the icon zone of a row
+*/
+struct SymbolLabel {
+	std::string name; // icon template name (accident, bomb, ...)
+	std::string size; // small, medium or large
+};
+
+/*
+* Cache of icon zone classifications, keyed by row and by a 64 bit
+* difference hash (dHash) of the zone.
+* A lookup hits when a zone of the same row was already classified and its
+* hash is at most maxDistance bits away. One hit out of verifyEvery is
+* recomputed to check the cache (0 disables verification).
+*/
+class SymbolCache {
+public:
+	typedef std::function<SymbolLabel(const cv::Mat&)> Classifier;
+
+	struct Stats {
+		uint64_t lookups = 0;
+		uint64_t hits = 0;
+		uint64_t verifications = 0;
+		uint64_t mismatches = 0;
+
+		double hitRate() const { return lookups ? (double)hits / lookups : 0.0; }
+	};
+
+	SymbolCache(int maxDistance = 6, int verifyEvery = 20, size_t maxEntriesPerRow = 8);
+
+	// Returns the label of the zone, from the cache when possible,
+	// otherwise from the classifier (and the result is cached)
+	SymbolLabel classify(int row, const cv::Mat& zone, const Classifier& classifier);
+
+	Stats stats() const;
+	void printStats(std::ostream& out) const;
+	void clear();
+
+	// 64 bit dHash of an image (gray or BGR): sign of the horizontal
+	// gradient of a 9x8 area-resampled gray version
+	static uint64_t dHash(const cv::Mat& image);
+	static int hammingDistance(uint64_t a, uint64_t b);
+
+private:
+	struct Entry {
+		uint64_t hash;
+		SymbolLabel label;
+	};
+
+	int maxDistance;
+	int verifyEvery;
+	size_t maxEntriesPerRow;
+
+	mutable std::mutex mutex;
+	std::map<int, std::vector<Entry> > rows;
+	Stats counters;
+
+	void store(int row, uint64_t hash, const SymbolLabel& label);
+};
+
+#endif /* SYMBOLCACHE_H_ */
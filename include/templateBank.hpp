@@ -0,0 +1,36 @@
+#ifndef TEMPLATEBANK_H_
+#define TEMPLATEBANK_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "symbolCache.hpp"
+
+/*
+* Templates of whatSymbols: <name>.png of the 14 symbols, and small.png,
+* medium.png, large.png for the size.
+* Read-only once loaded, so a bank can be shared between threads.
+*/
+class TemplateBank {
+public:
+	// Returns false if a template is missing
+	bool load(const std::string& directory);
+
+	const std::vector<cv::Mat>& symbols() const { return symbolTemplates; }
+	const std::vector<cv::Mat>& sizes() const { return sizeTemplates; }
+
+	// Best matching symbol and size of an icon zone
+	SymbolLabel whatSymbols(const cv::Mat& source) const;
+
+	// hash of the pixels of every template
+	uint64_t hash() const;
+
+private:
+	std::vector<cv::Mat> symbolTemplates;
+	std::vector<cv::Mat> sizeTemplates;
+};
+
+#endif /* TEMPLATEBANK_H_ */
@@ -0,0 +1,72 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+* Scoped trace spans and counters, exported as Chrome trace_event JSON
+* (chrome://tracing, ui.perfetto.dev).
+* Each thread records into its own ring buffer: no lock once the buffer of
+* the thread exists, the oldest events are overwritten when it is full.
+* The buffer of a thread that exits goes to the next thread that records,
+* so the memory follows the number of live threads.
+* While tracing is disabled a span only costs the test of a flag.
+* Names must be string literals, they are stored as pointers.
+*/
+class Tracer {
+public:
+	// Starts recording, eventsPerThread is the size of the ring buffers
+	static void enable(size_t eventsPerThread = 1 << 16);
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	// ns since enable()
+	static int64_t now();
+
+	static void record(const char* name, const char* argName, int64_t arg, int64_t start, int64_t duration);
+	static void counter(const char* name, int64_t value) {
+		if (isEnabled()) record(name, NULL, value, now(), -1);
+	}
+
+	// Name of the calling thread in the trace
+	static void setThreadName(const std::string& name);
+
+	// Writes the events of every thread; the traced threads should be idle
+	static bool exportChromeTrace(const std::string& path);
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+class TraceSpan {
+public:
+	explicit TraceSpan(const char* spanName, const char* spanArgName = NULL, int64_t spanArg = 0)
+		: active(Tracer::isEnabled()) {
+		if (!active) return;
+		name = spanName;
+		argName = spanArgName;
+		arg = spanArg;
+		start = Tracer::now();
+	}
+	~TraceSpan() {
+		if (active) Tracer::record(name, argName, arg, start, Tracer::now() - start);
+	}
+
+private:
+	bool active;
+	const char* name;
+	const char* argName;
+	int64_t arg;
+	int64_t start;
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// TRACE_SCOPE("name") or TRACE_SCOPE("name", "argument", value) until the end of the block
+#define TRACE_SCOPE(...) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(__VA_ARGS__)
+
+#endif /* TRACE_H_ */
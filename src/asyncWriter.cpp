@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <cstring>
+
+#include "opencv2/imgcodecs.hpp"
+
+#include "asyncWriter.hpp"
+#include "trace.hpp"
+
+
+thread_local std::vector<AsyncWriter::PendingWrite>* AsyncWriter::batchWrites = NULL;
+
+AsyncWriter::AsyncWriter(int numThreads, size_t maxInFlightBytes, size_t batchSize, bool useIoRing)
+	: maxInFlightBytes(maxInFlightBytes), batchSize(batchSize > 0 ? batchSize : 1), useIoRing(useIoRing),
+	files(0), bytes(0), errors(0), ringFiles(0) {
+	if (numThreads < 1) numThreads = 1;
+	for (int i = 0; i < numThreads; i++) {
+		workers.push_back(std::thread(&AsyncWriter::workerLoop, this, i));
+	}
+}
+
+AsyncWriter::~AsyncWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void AsyncWriter::writeImage(const std::string& path, const cv::Mat& roi, Task onWritten) {
+	// a ROI would keep its whole page alive while queued, beyond the bytes counted
+	cv::Mat image = roi.isSubmatrix() ? roi.clone() : roi;
+	submit(image.total() * image.elemSize(), [this, path, image, onWritten]() {
+		PendingWrite write = { path, std::vector<uchar>(), onWritten };
+		{
+			TRACE_SCOPE("encode");
+			cv::imencode(".png", image, write.data);
+		}
+		queueWrite(std::move(write));
+	});
+}
+
+void AsyncWriter::writeText(const std::string& path, const std::string& text) {
+	submit(text.size(), [this, path, text]() {
+		PendingWrite write = { path, std::vector<uchar>(text.begin(), text.end()), Task() };
+		queueWrite(std::move(write));
+	});
+}
+
+void AsyncWriter::queueWrite(PendingWrite write) {
+	if (batchWrites != NULL) {
+		batchWrites->push_back(std::move(write));
+		return;
+	}
+	if (writeFile(write.path, write.data.data(), write.data.size())) runOnWritten(write);
+}
+
+void AsyncWriter::writePending(IoRing& ring, std::vector<PendingWrite>& writes) {
+	if (writes.empty()) return;
+	TRACE_SCOPE("writeFiles", "files", writes.size());
+
+	std::vector<IoRing::FileWrite> ringWrites;
+	for (const PendingWrite& write : writes) {
+		IoRing::FileWrite w = { write.path.c_str(), write.data.data(), write.data.size(), 0 };
+		ringWrites.push_back(w);
+	}
+	if (ring.available() && ring.writeFiles(ringWrites)) {
+		for (size_t i = 0; i < writes.size(); i++) {
+			if (ringWrites[i].result < 0) {
+				errors++;
+				std::cerr << "AsyncWriter: couldn't write " << writes[i].path << ": " << std::strerror(-ringWrites[i].result) << std::endl;
+				continue;
+			}
+			files++;
+			ringFiles++;
+			bytes += writes[i].data.size();
+			runOnWritten(writes[i]);
+		}
+	}
+	else {
+		for (PendingWrite& write : writes) {
+			if (writeFile(write.path, write.data.data(), write.data.size())) runOnWritten(write);
+		}
+	}
+	writes.clear();
+}
+
+void AsyncWriter::runOnWritten(const PendingWrite& write) {
+	if (!write.onWritten) return;
+	try {
+		write.onWritten();
+	}
+	catch (const std::exception& e) {
+		errors++;
+		std::cerr << "AsyncWriter: " << e.what() << std::endl;
+	}
+}
+
+void AsyncWriter::submit(size_t jobBytes, Task task) {
+	std::unique_lock<std::mutex> lock(mutex);
+	// backpressure: a job bigger than the limit is still accepted when nothing else is in flight
+	jobDone.wait(lock, [&]() {
+		return inFlightBytes == 0 || inFlightBytes + jobBytes <= maxInFlightBytes;
+	});
+
+	Job job = { jobBytes, std::move(task) };
+	queue.push_back(std::move(job));
+	inFlightBytes += jobBytes;
+	pendingJobs++;
+	if (inFlightBytes > peakInFlightBytes) peakInFlightBytes = inFlightBytes;
+	lock.unlock();
+
+	jobAvailable.notify_one();
+}
+
+void AsyncWriter::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [&]() { return pendingJobs == 0; });
+}
+
+void AsyncWriter::workerLoop(int index) {
+	Tracer::setThreadName("writer " + std::to_string(index));
+	std::vector<Job> batch;
+	// one file of a batch needs 3 entries of the ring, spread over two submissions
+	IoRing ring(useIoRing ? (unsigned)(2 * batchSize) : 0);
+	std::vector<PendingWrite> pending;
+	batchWrites = &pending;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [&]() { return stopping || !queue.empty(); });
+			if (queue.empty()) return; // stopping and nothing left
+
+			// take a batch at once to limit the contention on the queue
+			while (!queue.empty() && batch.size() < batchSize) {
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+		}
+		// the other workers may take what remains
+		jobAvailable.notify_one();
+
+		TRACE_SCOPE("writeBatch", "jobs", batch.size());
+		size_t batchBytes = 0;
+		for (Job& job : batch) {
+			try {
+				job.task();
+			}
+			catch (const std::exception& e) {
+				errors++;
+				std::cerr << "AsyncWriter: " << e.what() << std::endl;
+			}
+			batchBytes += job.bytes;
+		}
+		writePending(ring, pending);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			inFlightBytes -= batchBytes;
+			pendingJobs -= batch.size();
+		}
+		jobDone.notify_all();
+		batch.clear();
+	}
+}
+
+bool AsyncWriter::writeFile(const std::string& path, const void* data, size_t size) {
+	TRACE_SCOPE("writeFile", "bytes", size);
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		errors++;
+		std::cerr << "AsyncWriter: couldn't open " << path << std::endl;
+		return false;
+	}
+
+	bool ok = std::fwrite(data, 1, size, file) == size;
+	ok = std::fclose(file) == 0 && ok;
+	if (!ok) {
+		errors++;
+		std::cerr << "AsyncWriter: couldn't write " << path << std::endl;
+		return false;
+	}
+
+	files++;
+	bytes += size;
+	return true;
+}
+
+AsyncWriter::Stats AsyncWriter::stats() const {
+	Stats s;
+	s.files = files;
+	s.bytes = bytes;
+	s.errors = errors;
+	s.ringFiles = ringFiles;
+	std::lock_guard<std::mutex> lock(mutex);
+	s.peakInFlightBytes = peakInFlightBytes;
+	return s;
+}
+
+void AsyncWriter::printStats(std::ostream& out) const {
+	Stats s = stats();
+	out << "writer: " << s.files << " files (" << s.ringFiles << " through io_uring), " << s.bytes << " bytes, "
+		<< s.errors << " errors, peak in flight " << s.peakInFlightBytes << " bytes" << std::endl;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cstring>
+
+#include "bitMask.hpp"
+#include "trace.hpp"
+
+using std::vector;
+
+static const uint64_t highBits = 0x8080808080808080ULL;
+
+// SWAR popcount
+static inline int popcount(uint64_t v) {
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((v * 0x0101010101010101ULL) >> 56);
+}
+
+// bits [from, to) of a word, 0 <= from < to <= 64
+static inline uint64_t bitRange(int from, int to) {
+	uint64_t upper = to == 64 ? ~0ULL : (1ULL << to) - 1;
+	return upper & ~((1ULL << from) - 1);
+}
+
+// bit i set for each byte i of the 8 pixels x >= t (t repeated in every byte)
+static inline uint64_t packGreaterEqual(uint64_t x, uint64_t t) {
+	// high bit of each byte: low 7 bits of x >= those of t, no borrow between bytes
+	uint64_t low = (x | highBits) - (t & ~highBits);
+	// then the high bits of x and t decide, unless they are equal
+	uint64_t ge = ((x & ~t) | (~(x ^ t) & low)) & highBits;
+	// gathers the high bit of byte i into bit 56 + i
+	return ((ge >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+BitMask::BitMask(cv::Size size)
+	: width(size.width), height(size.height), stride((size.width + 63) / 64),
+	words((size_t)stride * size.height, 0) {
+}
+
+void BitMask::fromThresholds(const cv::Mat& plane, const vector<int>& thresholds, vector<BitMask>& masks) {
+	TRACE_SCOPE("packThresholds", "levels", thresholds.size());
+	CV_Assert(plane.type() == CV_8U);
+	const size_t levels = thresholds.size();
+	masks.assign(levels, BitMask(plane.size()));
+
+	vector<uint64_t> repeated(levels);
+	for (size_t i = 0; i < levels; i++) {
+		// thresholds out of [1, 255] are handled apart: nothing or everything is set
+		uint64_t t = (uint64_t)std::min(std::max(thresholds[i], 0), 255);
+		repeated[i] = t * 0x0101010101010101ULL;
+	}
+
+	for (int y = 0; y < plane.rows; y++) {
+		const uchar* p = plane.ptr<uchar>(y);
+		int x = 0;
+		// 8 pixels at a time (little endian: pixel x + i is byte i)
+		for (; x + 8 <= plane.cols; x += 8) {
+			uint64_t pixels;
+			std::memcpy(&pixels, p + x, 8);
+			for (size_t i = 0; i < levels; i++) {
+				uint64_t bits = thresholds[i] > 255 ? 0 : thresholds[i] <= 0 ? 0xFF : packGreaterEqual(pixels, repeated[i]);
+				masks[i].row(y)[x >> 6] |= bits << (x & 63);
+			}
+		}
+		for (; x < plane.cols; x++) {
+			for (size_t i = 0; i < levels; i++) {
+				if (p[x] >= thresholds[i]) masks[i].row(y)[x >> 6] |= 1ULL << (x & 63);
+			}
+		}
+	}
+}
+
+BitMask BitMask::fromThreshold(const cv::Mat& plane, int threshold) {
+	vector<BitMask> masks;
+	fromThresholds(plane, vector<int>(1, threshold), masks);
+	return masks[0];
+}
+
+BitMask& BitMask::operator&=(const BitMask& other) {
+	CV_Assert(width == other.width && height == other.height);
+	for (size_t i = 0; i < words.size(); i++) words[i] &= other.words[i];
+	return *this;
+}
+
+BitMask& BitMask::operator|=(const BitMask& other) {
+	CV_Assert(width == other.width && height == other.height);
+	for (size_t i = 0; i < words.size(); i++) words[i] |= other.words[i];
+	return *this;
+}
+
+BitMask& BitMask::subtract(const BitMask& other) {
+	CV_Assert(width == other.width && height == other.height);
+	for (size_t i = 0; i < words.size(); i++) words[i] &= ~other.words[i];
+	return *this;
+}
+
+BitMask BitMask::dilated() const {
+	// rows dilated by 3 pixels, then each row ORed with its neighbours
+	BitMask wide(cv::Size(width, height));
+	const uint64_t lastWord = bitRange(0, width - (stride - 1) * 64);
+	for (int y = 0; y < height; y++) {
+		const uint64_t* in = row(y);
+		uint64_t* out = wide.row(y);
+		for (int w = 0; w < stride; w++) {
+			uint64_t left = (in[w] << 1) | (w > 0 ? in[w - 1] >> 63 : 0);
+			uint64_t right = (in[w] >> 1) | (w + 1 < stride ? in[w + 1] << 63 : 0);
+			out[w] = in[w] | left | right;
+		}
+		if (stride > 0) out[stride - 1] &= lastWord;
+	}
+
+	BitMask result(cv::Size(width, height));
+	for (int y = 0; y < height; y++) {
+		uint64_t* out = result.row(y);
+		for (int dy = -1; dy <= 1; dy++) {
+			if (y + dy < 0 || y + dy >= height) continue;
+			const uint64_t* in = wide.row(y + dy);
+			for (int w = 0; w < stride; w++) out[w] |= in[w];
+		}
+	}
+	return result;
+}
+
+int64_t BitMask::count() const {
+	int64_t total = 0;
+	for (uint64_t word : words) total += popcount(word);
+	return total;
+}
+
+int64_t BitMask::count(const cv::Rect& area) const {
+	cv::Rect roi = area & cv::Rect(0, 0, width, height);
+	if (roi.area() == 0) return 0;
+	int first = roi.x >> 6, last = (roi.x + roi.width - 1) >> 6;
+	int64_t total = 0;
+	for (int y = roi.y; y < roi.y + roi.height; y++) {
+		const uint64_t* r = row(y);
+		for (int w = first; w <= last; w++) {
+			int from = w == first ? roi.x & 63 : 0;
+			int to = w == last ? ((roi.x + roi.width - 1) & 63) + 1 : 64;
+			total += popcount(r[w] & bitRange(from, to));
+		}
+	}
+	return total;
+}
+
+int64_t BitMask::countDifferent(const BitMask& other) const {
+	CV_Assert(width == other.width && height == other.height);
+	int64_t total = 0;
+	for (size_t i = 0; i < words.size(); i++) total += popcount(words[i] ^ other.words[i]);
+	return total;
+}
+
+cv::Mat BitMask::toMat(const cv::Rect& area) const {
+	// 8 bits to 8 bytes of 0 or 255
+	static const struct Expansion {
+		uint64_t bytes[256];
+		Expansion() {
+			for (int b = 0; b < 256; b++) {
+				bytes[b] = 0;
+				for (int i = 0; i < 8; i++) if (b & (1 << i)) bytes[b] |= 0xFFULL << (8 * i);
+			}
+		}
+	} expansion;
+
+	cv::Rect roi = area & cv::Rect(0, 0, width, height);
+	cv::Mat mat(roi.height, roi.width, CV_8U);
+	for (int y = 0; y < roi.height; y++) {
+		const uint64_t* r = row(roi.y + y);
+		uchar* p = mat.ptr<uchar>(y);
+		int x = 0;
+		// whole bytes of the mask once the source is byte aligned
+		for (; x < roi.width && ((roi.x + x) & 7) != 0; x++) p[x] = (r[(roi.x + x) >> 6] >> ((roi.x + x) & 63)) & 1 ? 255 : 0;
+		for (; x + 8 <= roi.width; x += 8) {
+			int sx = roi.x + x;
+			uint64_t bytes = expansion.bytes[(r[sx >> 6] >> (sx & 63)) & 0xFF];
+			std::memcpy(p + x, &bytes, 8);
+		}
+		for (; x < roi.width; x++) p[x] = (r[(roi.x + x) >> 6] >> ((roi.x + x) & 63)) & 1 ? 255 : 0;
+	}
+	return mat;
+}
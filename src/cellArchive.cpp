@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "opencv2/imgcodecs.hpp"
+
+#include "cellArchive.hpp"
+#include "trace.hpp"
+
+static const char archiveMagic[8] = "NICPACK";
+static const uint32_t archiveVersion = 1;
+
+// copies s into a fixed size NUL padded field, truncating it if needed
+static void copyField(char* field, size_t fieldSize, const std::string& s) {
+	std::memset(field, 0, fieldSize);
+	std::memcpy(field, s.data(), std::min(s.size(), fieldSize - 1));
+}
+
+static std::string readField(const char* field, size_t fieldSize) {
+	return std::string(field, strnlen(field, fieldSize));
+}
+
+static bool recordLess(const ArchiveRecord& a, const ArchiveRecord& b) {
+	return std::strncmp(a.key, b.key, sizeof(a.key)) < 0;
+}
+
+
+ArchiveWriter::ArchiveWriter() : pack(NULL), packSize(0), failed(false) {
+}
+
+ArchiveWriter::~ArchiveWriter() {
+	close();
+}
+
+bool ArchiveWriter::open(const std::string& base) {
+	close();
+	basePath = base;
+	records.clear();
+	failed = false;
+
+	// cells already in the shard
+	ArchiveReader existing;
+	if (existing.open(base) && existing.size() > 0) {
+		records.assign(&existing.record(0), &existing.record(0) + existing.size());
+	}
+
+	pack = std::fopen((base + ".pack").c_str(), "ab");
+	if (pack == NULL) return false;
+	std::setvbuf(pack, NULL, _IOFBF, 1 << 20);
+
+	// 64 bit position, packs grow beyond 2 GB
+#ifdef _WIN32
+	_fseeki64(pack, 0, SEEK_END);
+	packSize = (uint64_t)_ftelli64(pack);
+#else
+	fseeko(pack, 0, SEEK_END);
+	packSize = (uint64_t)ftello(pack);
+#endif
+	return true;
+}
+
+bool ArchiveWriter::append(const CellInfo& cell, const void* data, size_t size) {
+	ArchiveRecord record;
+	copyField(record.key, sizeof(record.key), getFileName(cell));
+	copyField(record.label, sizeof(record.label), cell.label);
+	copyField(record.size, sizeof(record.size), cell.size);
+	copyField(record.scripter, sizeof(record.scripter), cell.scripter);
+	copyField(record.page, sizeof(record.page), cell.page);
+	record.row = (uint16_t)cell.row;
+	record.column = (uint16_t)cell.column;
+	record.length = (uint32_t)size;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (pack == NULL) return false;
+
+	record.offset = packSize;
+	if (std::fwrite(data, 1, size, pack) != size) {
+		failed = true;
+		return false;
+	}
+	packSize += size;
+	records.push_back(record);
+	return true;
+}
+
+bool ArchiveWriter::appendImage(const CellInfo& cell, const cv::Mat& image) {
+	TRACE_SCOPE("appendImage");
+	std::vector<uchar> buffer;
+	if (!cv::imencode(".png", image, buffer)) return false;
+	return append(cell, buffer.data(), buffer.size());
+}
+
+void ArchiveWriter::remove(const std::vector<std::string>& keys) {
+	std::vector<ArchiveRecord> removed(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) copyField(removed[i].key, sizeof(removed[i].key), keys[i]);
+	std::sort(removed.begin(), removed.end(), recordLess);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	records.erase(std::remove_if(records.begin(), records.end(), [&](const ArchiveRecord& record) {
+		return std::binary_search(removed.begin(), removed.end(), record, recordLess);
+	}), records.end());
+}
+
+bool ArchiveWriter::checkpoint() {
+	TRACE_SCOPE("archiveCheckpoint");
+	std::lock_guard<std::mutex> lock(mutex);
+	if (pack == NULL) return false;
+
+	// the index must not reference bytes still in the stdio buffer
+	bool ok = std::fflush(pack) == 0 && !failed;
+	return writeIndex() && ok;
+}
+
+bool ArchiveWriter::close() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (pack == NULL) return !failed;
+
+	bool ok = std::fclose(pack) == 0 && !failed;
+	pack = NULL;
+	return writeIndex() && ok;
+}
+
+// called with the mutex held
+bool ArchiveWriter::writeIndex() {
+	// sorted by key, the last append of a key wins
+	std::stable_sort(records.begin(), records.end(), recordLess);
+	std::vector<ArchiveRecord> unique;
+	for (size_t i = 0; i < records.size(); i++) {
+		if (i + 1 < records.size() && !recordLess(records[i], records[i + 1])) continue;
+		unique.push_back(records[i]);
+	}
+	records.swap(unique);
+
+	ArchiveIndexHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, archiveMagic, sizeof(header.magic));
+	header.version = archiveVersion;
+	header.recordSize = sizeof(ArchiveRecord);
+	header.count = records.size();
+
+	// written aside then renamed so that a reader never sees a partial index
+	std::string indexPath = basePath + ".idx";
+	std::string tmpPath = indexPath + ".tmp";
+	FILE* index = std::fopen(tmpPath.c_str(), "wb");
+	if (index == NULL) return false;
+	bool ok = std::fwrite(&header, sizeof(header), 1, index) == 1;
+	if (!records.empty()) {
+		ok = std::fwrite(records.data(), sizeof(ArchiveRecord), records.size(), index) == records.size() && ok;
+	}
+	ok = std::fclose(index) == 0 && ok;
+
+	std::remove(indexPath.c_str());
+	ok = std::rename(tmpPath.c_str(), indexPath.c_str()) == 0 && ok;
+	if (!ok) std::cerr << "ArchiveWriter: couldn't save " << basePath << std::endl;
+	return ok;
+}
+
+size_t ArchiveWriter::count() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return records.size();
+}
+
+
+bool ArchiveReader::open(const std::string& basePath) {
+	close();
+	if (!indexFile.open(basePath + ".idx") || indexFile.size() < sizeof(ArchiveIndexHeader)) {
+		close();
+		return false;
+	}
+
+	const ArchiveIndexHeader* header = (const ArchiveIndexHeader*)indexFile.data();
+	if (std::memcmp(header->magic, archiveMagic, sizeof(header->magic)) != 0
+		|| header->version != archiveVersion
+		|| header->recordSize != sizeof(ArchiveRecord)
+		|| indexFile.size() != sizeof(ArchiveIndexHeader) + header->count * sizeof(ArchiveRecord)) {
+		std::cerr << "ArchiveReader: invalid index " << basePath << ".idx" << std::endl;
+		close();
+		return false;
+	}
+
+	if (!packFile.open(basePath + ".pack")) {
+		close();
+		return false;
+	}
+
+	records = (const ArchiveRecord*)(indexFile.data() + sizeof(ArchiveIndexHeader));
+	count = (size_t)header->count;
+	return true;
+}
+
+void ArchiveReader::close() {
+	indexFile.close();
+	packFile.close();
+	records = NULL;
+	count = 0;
+}
+
+const ArchiveRecord* ArchiveReader::find(const std::string& key) const {
+	ArchiveRecord probe;
+	copyField(probe.key, sizeof(probe.key), key);
+
+	const ArchiveRecord* end = records + count;
+	const ArchiveRecord* it = std::lower_bound(records, end, probe, recordLess);
+	if (it == end || recordLess(probe, *it)) return NULL;
+	return it;
+}
+
+const unsigned char* ArchiveReader::data(const ArchiveRecord& record) const {
+	if (record.offset + record.length > packFile.size()) return NULL;
+	return packFile.data() + record.offset;
+}
+
+cv::Mat ArchiveReader::decode(const ArchiveRecord& record, int flags) const {
+	const unsigned char* bytes = data(record);
+	// length 0: blank cell, recorded without its crop
+	if (bytes == NULL || record.length == 0) return cv::Mat();
+	// no copy: the header points into the mapping
+	cv::Mat encoded(1, (int)record.length, CV_8U, (void*)bytes);
+	return cv::imdecode(encoded, flags);
+}
+
+CellInfo ArchiveReader::toCellInfo(const ArchiveRecord& record) {
+	CellInfo cell;
+	cell.label = readField(record.label, sizeof(record.label));
+	cell.size = readField(record.size, sizeof(record.size));
+	cell.scripter = readField(record.scripter, sizeof(record.scripter));
+	cell.page = readField(record.page, sizeof(record.page));
+	cell.row = record.row;
+	cell.column = record.column;
+	return cell;
+}
@@ -0,0 +1,27 @@
+#include <sstream>
+
+#include "cellInfo.hpp"
+
+
+std::string getFileName(const CellInfo& cell) {
+	return cell.label + "_" + cell.scripter + "_" + cell.page + "_"
+		+ std::to_string(cell.row) + "_" + std::to_string(cell.column);
+}
+
+std::string getMetadataText(const CellInfo& cell) {
+	std::ostringstream metadata;
+	metadata << "# 2017 Groupe Beaulieu Fournier Saulnier\n"
+		<< "label " << cell.label << "\n"
+		<< "form " << cell.scripter + cell.page << "\n"
+		<< "scripter " << cell.scripter << "\n"
+		<< "page " << cell.page << "\n"
+		<< "row " << cell.row << "\n"
+		<< "column " << cell.column << "\n"
+		<< "size " << cell.size << "\n";
+	if (cell.inkRatio >= 0) {
+		metadata << "ink " << cell.inkRatio << "\n"
+			<< "inkbox " << cell.inkX << " " << cell.inkY << " " << cell.inkWidth << " " << cell.inkHeight << "\n"
+			<< "inkcenter " << cell.inkCenterX << " " << cell.inkCenterY << "\n";
+	}
+	return metadata.str();
+}
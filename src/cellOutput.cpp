@@ -0,0 +1,59 @@
+#include "cellOutput.hpp"
+
+
+CellOutput::CellOutput(AsyncWriter& writer, ArchiveWriter& archive, ManifestWriter& manifest, const std::string& prefix)
+	: writer(writer), archive(archive), manifest(manifest), prefix(prefix) {
+}
+
+std::string CellOutput::write(const CellInfo& cell, const cv::Mat& crop, std::vector<std::string>& outputs) {
+	std::string filename = getFileName(cell);
+
+	if (archive.isOpen()) {
+		ArchiveWriter* shard = &archive;
+		AsyncWriter* errors = &writer;
+		// copied as in writeImage: the queue holds the crop, not its page
+		cv::Mat image = crop.isSubmatrix() ? crop.clone() : crop;
+		writer.submit(image.total() * image.elemSize(), [shard, errors, cell, image]() {
+			// a failed record fails the checkpoint of the page, as a failed png
+			if (!shard->appendImage(cell, image)) errors->countError();
+		});
+		outputs.push_back(archive.path() + "#" + filename);
+		return filename;
+	}
+
+	std::string pngPath = prefix + filename + ".png";
+	outputs.push_back(pngPath);
+	if (manifest.isOpen()) {
+		// the row is added by the writer thread once the crop is on disk
+		ManifestWriter* rows = &manifest;
+		writer.writeImage(pngPath, crop, [rows, cell, pngPath]() {
+			rows->addRow(cell, pngPath);
+		});
+		return pngPath;
+	}
+
+	writer.writeImage(pngPath, crop);
+	writer.writeText(prefix + filename + ".txt", getMetadataText(cell));
+	outputs.push_back(prefix + filename + ".txt");
+	return pngPath;
+}
+
+void CellOutput::writeBlank(const CellInfo& cell, std::vector<std::string>& outputs) {
+	std::string filename = getFileName(cell);
+
+	if (archive.isOpen()) {
+		ArchiveWriter* shard = &archive;
+		AsyncWriter* errors = &writer;
+		writer.submit(0, [shard, errors, cell]() {
+			if (!shard->append(cell, NULL, 0)) errors->countError();
+		});
+		outputs.push_back(archive.path() + "#" + filename);
+		return;
+	}
+	if (manifest.isOpen()) {
+		manifest.addRow(cell, "");
+		return;
+	}
+	writer.writeText(prefix + filename + ".txt", getMetadataText(cell));
+	outputs.push_back(prefix + filename + ".txt");
+}
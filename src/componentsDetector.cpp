@@ -0,0 +1,76 @@
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "gridCells.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+
+// keeps the paper region box (area pixels) of a page of size page when it may be a cell
+static void addCellRegion(const cv::Rect& box, double area, const cv::Size& page, vector<square_t>& squares, const DetectionConfig& config)
+{
+	// the paper around the grids touches the border of the page
+	if (box.x == 0 || box.y == 0 || box.x + box.width == page.width || box.y + box.height == page.height) return;
+	// geometry of a cell: large, about square, and filled but for the writing
+	if ((double)box.area() <= config.minContourArea) return;
+	double aspect = (double)box.width / box.height;
+	if (aspect < 1 / config.maxCellAspect || aspect > config.maxCellAspect) return;
+	if (area < config.minCellFill * box.area()) return;
+
+	squares.push_back(rectSquare(box));
+}
+
+void findGridCellsComponents(const cv::Mat& image, vector<square_t>& squares, const DetectionConfig& config)
+{
+	TRACE_SCOPE("findGridCellsComponents");
+	squares.clear();
+
+	// the inside of a cell is a region of paper closed by the printed lines
+	cv::Mat ink, paper;
+	binarizeInk(image, ink);
+	cv::bitwise_not(ink, paper);
+
+	// 4-connectivity: paper doesn't leak through the corners of the lines.
+	// OpenCV labels it with Wu's scan array union find (SAUF), run in parallel;
+	// Grana's block based BBDT only exists for 8-connectivity
+	cv::Mat labels, stats, centroids;
+	int count;
+	{
+		TRACE_SCOPE("connectedComponents");
+		count = cv::connectedComponentsWithStats(paper, labels, stats, centroids, 4, CV_32S, cv::CCL_WU);
+	}
+	Tracer::counter("components", count);
+
+	for (int label = 1; label < count; label++)
+	{
+		const int* s = stats.ptr<int>(label);
+		cv::Rect box(s[cv::CC_STAT_LEFT], s[cv::CC_STAT_TOP], s[cv::CC_STAT_WIDTH], s[cv::CC_STAT_HEIGHT]);
+		addCellRegion(box, s[cv::CC_STAT_AREA], image.size(), squares, config);
+	}
+
+	keepRegularCells(squares, config.gridRegularity);
+	sortCellsByRow(squares);
+	Tracer::counter("squares found", squares.size());
+}
+
+void findGridCellsRuns(const cv::Mat& image, vector<square_t>& squares, const DetectionConfig& config)
+{
+	TRACE_SCOPE("findGridCellsRuns");
+	squares.clear();
+
+	// same regions as findGridCellsComponents, labelled on the runs of paper:
+	// neither the ink mask nor the label image is written
+	RunLengthMask paper = binarizeInkRuns(image).inverted();
+	vector<RunLengthMask::Component> regions = paper.components(false);
+	Tracer::counter("components", regions.size());
+
+	for (const RunLengthMask::Component& region : regions)
+	{
+		addCellRegion(region.box, (double)region.area, image.size(), squares, config);
+	}
+
+	keepRegularCells(squares, config.gridRegularity);
+	sortCellsByRow(squares);
+	Tracer::counter("squares found", squares.size());
+}
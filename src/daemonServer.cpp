@@ -0,0 +1,221 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "daemonServer.hpp"
+
+#ifdef MSG_NOSIGNAL
+static const int sendFlags = MSG_NOSIGNAL;
+#else
+static const int sendFlags = 0;
+#endif
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+	stopRequested = 1;
+}
+
+
+DaemonServer::DaemonServer() : listenFd(-1) {
+}
+
+DaemonServer::~DaemonServer() {
+	closeSocket(listenFd);
+#ifndef _WIN32
+	if (!socketPath.empty()) unlink(socketPath.c_str());
+#endif
+}
+
+#ifdef _WIN32
+
+bool DaemonServer::listen(const std::string&) {
+	std::cerr << "DaemonServer: Unix domain sockets aren't supported on this platform" << std::endl;
+	return false;
+}
+
+void DaemonServer::serve(const Handler&) {
+}
+
+void DaemonServer::serveConnection(int, const Handler&, Connection*) {
+}
+
+void DaemonServer::reapConnections() {
+}
+
+int DaemonServer::connectTo(const std::string&) {
+	return -1;
+}
+
+bool DaemonServer::sendMessage(int, const std::string&) {
+	return false;
+}
+
+bool DaemonServer::receiveMessage(int, std::string&, size_t) {
+	return false;
+}
+
+void DaemonServer::closeSocket(int) {
+}
+
+#else
+
+static bool makeAddress(const std::string& path, sockaddr_un& address) {
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) return false;
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	return true;
+}
+
+static bool sendAll(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		ssize_t sent = send(fd, data, size, sendFlags);
+		if (sent <= 0) return false;
+		data += sent;
+		size -= (size_t)sent;
+	}
+	return true;
+}
+
+static bool receiveAll(int fd, char* data, size_t size) {
+	while (size > 0) {
+		ssize_t received = recv(fd, data, size, 0);
+		if (received <= 0) return false;
+		data += received;
+		size -= (size_t)received;
+	}
+	return true;
+}
+
+bool DaemonServer::listen(const std::string& path) {
+	sockaddr_un address;
+	if (!makeAddress(path, address)) {
+		std::cerr << "DaemonServer: socket path too long " << path << std::endl;
+		return false;
+	}
+
+	unlink(path.c_str());
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0
+		|| bind(listenFd, (const sockaddr*)&address, sizeof(address)) != 0
+		|| ::listen(listenFd, 16) != 0) {
+		std::cerr << "DaemonServer: couldn't listen on " << path << ": " << std::strerror(errno) << std::endl;
+		closeSocket(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	socketPath = path;
+	return true;
+}
+
+void DaemonServer::serve(const Handler& handler) {
+	stopRequested = 0;
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+	std::signal(SIGPIPE, SIG_IGN);
+
+	while (!stopRequested) {
+		reapConnections();
+
+		// timeout to check the stop flag
+		struct pollfd pfd = { listenFd, POLLIN, 0 };
+		if (poll(&pfd, 1, 200) <= 0) continue;
+
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0) continue;
+
+		// the thread can't mark its connection finished before it is stored: the lock is held
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		clients.insert(fd);
+		connections.push_back(Connection());
+		Connection* connection = &connections.back();
+		connection->thread = std::thread(&DaemonServer::serveConnection, this, fd, std::cref(handler), connection);
+	}
+
+	// wakes up the connections blocked on a read
+	{
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		for (int fd : clients) shutdown(fd, SHUT_RDWR);
+	}
+	for (Connection& connection : connections) connection.thread.join();
+	connections.clear();
+
+	std::signal(SIGINT, SIG_DFL);
+	std::signal(SIGTERM, SIG_DFL);
+}
+
+void DaemonServer::serveConnection(int fd, const Handler& handler, Connection* connection) {
+	std::string request;
+	while (receiveMessage(fd, request, maxRequestBytes)) {
+		if (!sendMessage(fd, handler(request))) break;
+	}
+
+	std::lock_guard<std::mutex> lock(clientsMutex);
+	clients.erase(fd);
+	close(fd);
+	connection->finished = true;
+}
+
+void DaemonServer::reapConnections() {
+	std::lock_guard<std::mutex> lock(clientsMutex);
+	for (auto it = connections.begin(); it != connections.end(); ) {
+		if (!it->finished) {
+			++it;
+			continue;
+		}
+		// the thread only has to return: it released the lock
+		it->thread.join();
+		it = connections.erase(it);
+	}
+}
+
+int DaemonServer::connectTo(const std::string& path) {
+	sockaddr_un address;
+	if (!makeAddress(path, address)) return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect(fd, (const sockaddr*)&address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool DaemonServer::sendMessage(int fd, const std::string& payload) {
+	uint32_t size = (uint32_t)payload.size();
+	unsigned char header[4] = {
+		(unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size
+	};
+	return sendAll(fd, (const char*)header, 4) && sendAll(fd, payload.data(), payload.size());
+}
+
+bool DaemonServer::receiveMessage(int fd, std::string& payload, size_t maxBytes) {
+	unsigned char header[4];
+	if (!receiveAll(fd, (char*)header, 4)) return false;
+
+	uint32_t size = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+	if (size > maxBytes) {
+		// checked before allocating: the caller closes the connection
+		std::cerr << "DaemonServer: message of " << size << " bytes refused (limit " << maxBytes << ")" << std::endl;
+		return false;
+	}
+	payload.resize(size);
+	return size == 0 || receiveAll(fd, &payload[0], size);
+}
+
+void DaemonServer::closeSocket(int fd) {
+	if (fd >= 0) close(fd);
+}
+
+#endif
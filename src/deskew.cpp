@@ -0,0 +1,72 @@
+#include <cmath>
+#include <vector>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "deskew.hpp"
+#include "trace.hpp"
+
+using std::vector;
+
+
+// sum of the squared bins of the profile of the points along rows rotated by angle
+static double profileSharpness(const vector<cv::Point2f>& points, double angle, vector<int>& profile) {
+	double radians = angle * CV_PI / 180;
+	double sine = std::sin(radians), cosine = std::cos(radians);
+	int offset = (int)profile.size() / 2;
+
+	std::fill(profile.begin(), profile.end(), 0);
+	for (const cv::Point2f& p : points) {
+		// y of the point once rotated as getRotationMatrix2D would, coordinates from the center
+		int y = cvRound(cosine * p.y - sine * p.x) + offset;
+		if (y >= 0 && y < (int)profile.size()) profile[y]++;
+	}
+
+	double sharpness = 0;
+	for (int count : profile) sharpness += (double)count * count;
+	return sharpness;
+}
+
+static double bestAngle(const vector<cv::Point2f>& points, double from, double to, double step, vector<int>& profile) {
+	double best = 0, bestSharpness = -1;
+	for (double angle = from; angle <= to + step / 2; angle += step) {
+		double sharpness = profileSharpness(points, angle, profile);
+		// ties go to the smallest correction
+		if (sharpness > bestSharpness || (sharpness == bestSharpness && std::fabs(angle) < std::fabs(best))) {
+			bestSharpness = sharpness;
+			best = angle;
+		}
+	}
+	return best;
+}
+
+double estimateSkew(const cv::Mat& page, double maxAngle, double proxyScale) {
+	TRACE_SCOPE("estimateSkew");
+	if (page.empty()) return 0;
+
+	cv::Mat proxy, gray;
+	cv::resize(page, proxy, cv::Size(), proxyScale, proxyScale, cv::INTER_AREA);
+	if (proxy.channels() == 3) cv::cvtColor(proxy, gray, cv::COLOR_BGR2GRAY);
+	else gray = proxy;
+	cv::threshold(gray, gray, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+	// dark pixels, from the center of the proxy
+	vector<cv::Point2f> points;
+	float cx = gray.cols / 2.f, cy = gray.rows / 2.f;
+	for (int y = 0; y < gray.rows; y++) {
+		const uchar* row = gray.ptr<uchar>(y);
+		for (int x = 0; x < gray.cols; x++) {
+			if (row[x]) points.push_back(cv::Point2f(x - cx, y - cy));
+		}
+	}
+	Tracer::counter("skew points", points.size());
+	if (points.size() < 100) return 0;
+
+	vector<int> profile((size_t)std::ceil(std::sqrt((double)gray.cols * gray.cols + (double)gray.rows * gray.rows)) + 2);
+	double coarse = bestAngle(points, -maxAngle, maxAngle, 0.25, profile);
+	return bestAngle(points, coarse - 0.25, coarse + 0.25, 0.025, profile);
+}
+
+cv::Mat straighteningTransform(const cv::Size& pageSize, double angle) {
+	return cv::getRotationMatrix2D(cv::Point2f(pageSize.width / 2.f, pageSize.height / 2.f), angle, 1);
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+
+#include "detectionConfig.hpp"
+#include "hashing.hpp"
+
+
+// operator>> of cv::FileNode resets the value when the key is missing
+template <typename T>
+static void readIfPresent(const cv::FileNode& node, T& value) {
+	if (!node.empty()) node >> value;
+}
+
+std::vector<DetectionPass> DetectionConfig::activePasses() const {
+	std::vector<DetectionPass> active;
+	for (int c = 0; c < 3; c++) {
+		for (int l = 0; l < levels; l++) {
+			bool selected = passes.empty();
+			for (const DetectionPass& pass : passes) {
+				if (pass.channel == c && pass.level == l) selected = true;
+			}
+			if (selected) active.push_back({ c, l });
+		}
+	}
+	return active;
+}
+
+DetectionConfig DetectionConfig::scaled(double factor) const {
+	DetectionConfig config = *this;
+	config.minContourArea = minContourArea * factor * factor;
+	config.minLineLength = minLineLength * factor;
+	// filterBySize measures about the square root of the side
+	config.minSquareWidth = minSquareWidth * std::sqrt(factor);
+	config.maxSquareWidth = maxSquareWidth * std::sqrt(factor);
+	config.overlapTolX = (float)(overlapTolX * factor);
+	config.overlapTolY = (float)(overlapTolY * factor);
+	config.rowTolerance = (float)(rowTolerance * factor);
+	config.iconZoneWidth = cvRound(iconZoneWidth * factor);
+	config.iconZoneHeight = cvRound(iconZoneHeight * factor);
+	config.referenceCellSide = referenceCellSide * factor;
+	return config;
+}
+
+bool DetectionConfig::load(const std::string& path) {
+	cv::FileStorage fs;
+	try {
+		if (!fs.open(path, cv::FileStorage::READ)) return false;
+	}
+	catch (const cv::Exception& e) {
+		std::cerr << "DetectionConfig: " << e.what() << std::endl;
+		return false;
+	}
+
+	cv::String engineName;
+	readIfPresent(fs["engine"], engineName);
+	if (!engineName.empty()) engine = engineName;
+	readIfPresent(fs["thresh"], thresh);
+	readIfPresent(fs["levels"], levels);
+	readIfPresent(fs["minSquareWidth"], minSquareWidth);
+	readIfPresent(fs["maxSquareWidth"], maxSquareWidth);
+	readIfPresent(fs["overlapTolX"], overlapTolX);
+	readIfPresent(fs["overlapTolY"], overlapTolY);
+	readIfPresent(fs["rowTolerance"], rowTolerance);
+	readIfPresent(fs["iconZoneWidth"], iconZoneWidth);
+	readIfPresent(fs["iconZoneHeight"], iconZoneHeight);
+	readIfPresent(fs["symbolCacheDistance"], symbolCacheDistance);
+	readIfPresent(fs["symbolVerifyEvery"], symbolVerifyEvery);
+	readIfPresent(fs["minContourArea"], minContourArea);
+	readIfPresent(fs["minGridCells"], minGridCells);
+	readIfPresent(fs["gridRegularity"], gridRegularity);
+	readIfPresent(fs["maxCellAspect"], maxCellAspect);
+	readIfPresent(fs["minCellFill"], minCellFill);
+	readIfPresent(fs["minLineLength"], minLineLength);
+	readIfPresent(fs["minLineCoverage"], minLineCoverage);
+	int adaptive = adaptiveLevels;
+	readIfPresent(fs["adaptiveLevels"], adaptive);
+	adaptiveLevels = adaptive != 0;
+	readIfPresent(fs["minSeparability"], minSeparability);
+	readIfPresent(fs["minAdaptiveQuads"], minAdaptiveQuads);
+	int estimate = estimateScale;
+	readIfPresent(fs["estimateScale"], estimate);
+	estimateScale = estimate != 0;
+	readIfPresent(fs["referenceCellSide"], referenceCellSide);
+	readIfPresent(fs["detectionScale"], detectionScale);
+	int straighten = deskew;
+	readIfPresent(fs["deskew"], straighten);
+	deskew = straighten != 0;
+	readIfPresent(fs["skewThreshold"], skewThreshold);
+	readIfPresent(fs["maxSkew"], maxSkew);
+	int ink = inkStats;
+	readIfPresent(fs["inkStats"], ink);
+	inkStats = ink != 0;
+	readIfPresent(fs["inkMargin"], inkMargin);
+	readIfPresent(fs["minInkRatio"], minInkRatio);
+
+	cv::FileNode passList = fs["passes"];
+	if (!passList.empty()) {
+		passes.clear();
+		for (cv::FileNodeIterator it = passList.begin(); it != passList.end(); ++it) {
+			DetectionPass pass = { (int)(*it)["channel"], (int)(*it)["level"] };
+			passes.push_back(pass);
+		}
+	}
+	return levels > 0 && detectionScale > 0 && detectionScale <= 1;
+}
+
+bool DetectionConfig::save(const std::string& path) const {
+	cv::FileStorage fs;
+	try {
+		if (!fs.open(path, cv::FileStorage::WRITE)) return false;
+	}
+	catch (const cv::Exception& e) {
+		std::cerr << "DetectionConfig: " << e.what() << std::endl;
+		return false;
+	}
+
+	fs << "engine" << engine;
+	fs << "thresh" << thresh;
+	fs << "levels" << levels;
+	fs << "passes" << "[";
+	for (const DetectionPass& pass : passes) {
+		fs << "{:" << "channel" << pass.channel << "level" << pass.level << "}";
+	}
+	fs << "]";
+	fs << "minSquareWidth" << minSquareWidth;
+	fs << "maxSquareWidth" << maxSquareWidth;
+	fs << "overlapTolX" << overlapTolX;
+	fs << "overlapTolY" << overlapTolY;
+	fs << "rowTolerance" << rowTolerance;
+	fs << "iconZoneWidth" << iconZoneWidth;
+	fs << "iconZoneHeight" << iconZoneHeight;
+	fs << "symbolCacheDistance" << symbolCacheDistance;
+	fs << "symbolVerifyEvery" << symbolVerifyEvery;
+	fs << "minContourArea" << minContourArea;
+	fs << "minGridCells" << minGridCells;
+	fs << "gridRegularity" << gridRegularity;
+	fs << "maxCellAspect" << maxCellAspect;
+	fs << "minCellFill" << minCellFill;
+	fs << "minLineLength" << minLineLength;
+	fs << "minLineCoverage" << minLineCoverage;
+	fs << "adaptiveLevels" << (int)adaptiveLevels;
+	fs << "minSeparability" << minSeparability;
+	fs << "minAdaptiveQuads" << minAdaptiveQuads;
+	fs << "estimateScale" << (int)estimateScale;
+	fs << "referenceCellSide" << referenceCellSide;
+	fs << "detectionScale" << detectionScale;
+	fs << "deskew" << (int)deskew;
+	fs << "skewThreshold" << skewThreshold;
+	fs << "maxSkew" << maxSkew;
+	fs << "inkStats" << (int)inkStats;
+	fs << "inkMargin" << inkMargin;
+	fs << "minInkRatio" << minInkRatio;
+	fs.release();
+	return true;
+}
+
+uint64_t DetectionConfig::detectionHash() const {
+	double parameters[] = { (double)thresh, (double)levels, minSquareWidth, maxSquareWidth,
+		overlapTolX, overlapTolY, rowTolerance, (double)iconZoneWidth, (double)iconZoneHeight,
+		minContourArea, (double)minGridCells, gridRegularity, maxCellAspect, minCellFill, minLineLength, minLineCoverage, (double)adaptiveLevels, minSeparability, (double)minAdaptiveQuads, (double)estimateScale, referenceCellSide, detectionScale,
+		(double)deskew, skewThreshold, maxSkew };
+	uint64_t h = fnv1a64(parameters, sizeof(parameters));
+	for (const DetectionPass& pass : activePasses()) {
+		int p[] = { pass.channel, pass.level };
+		h = fnv1a64(p, sizeof(p), h);
+	}
+	return fnv1a64(engine.data(), engine.size(), h);
+}
+
+uint64_t DetectionConfig::classificationHash() const {
+	double parameters[] = { (double)symbolCacheDistance, (double)symbolVerifyEvery, (double)inkStats, inkMargin, minInkRatio };
+	return fnv1a64(parameters, sizeof(parameters));
+}
+
+bool loadConfigOption(const cv::CommandLineParser& parser, DetectionConfig& config) {
+	const std::string path = parser.get<cv::String>("config");
+	if (path.empty() || config.load(path)) return true;
+	std::cout << "Couldn't load configuration " << path << std::endl;
+	return false;
+}
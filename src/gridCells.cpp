@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "gridCells.hpp"
+#include "histogram.hpp"
+
+using std::vector;
+
+
+void binarizeInk(const cv::Mat& image, cv::Mat& ink) {
+	cv::Mat gray;
+	if (image.channels() == 3) cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+	else gray = image;
+	cv::threshold(gray, ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+}
+
+RunLengthMask binarizeInkRuns(const cv::Mat& image) {
+	cv::Mat gray;
+	if (image.channels() == 3) cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+	else gray = image;
+	// first level of the paper class: the ink of THRESH_BINARY_INV | THRESH_OTSU is below it
+	int level = otsuThreshold(computeChannelHistograms(gray).counts[0]);
+	return RunLengthMask::fromThreshold(gray, level, true);
+}
+
+square_t rectSquare(const cv::Rect& rect) {
+	square_t sq;
+	sq.push_back(rect.tl());
+	sq.push_back(cv::Point(rect.x + rect.width, rect.y));
+	sq.push_back(rect.br());
+	sq.push_back(cv::Point(rect.x, rect.y + rect.height));
+	return sq;
+}
+
+static double median(vector<double> values) {
+	std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+	return values[values.size() / 2];
+}
+
+void keepRegularCells(vector<square_t>& squares, double regularity) {
+	if (squares.empty()) return;
+	vector<double> widths, heights;
+	for (const square_t& sq : squares) {
+		cv::Rect box = cv::boundingRect(sq);
+		widths.push_back(box.width);
+		heights.push_back(box.height);
+	}
+	double width = median(widths), height = median(heights);
+
+	vector<square_t> kept;
+	for (size_t i = 0; i < squares.size(); i++) {
+		if (std::abs(widths[i] - width) <= regularity * width && std::abs(heights[i] - height) <= regularity * height)
+			kept.push_back(squares[i]);
+	}
+	squares.swap(kept);
+}
+
+void sortCellsByRow(vector<square_t>& squares) {
+	if (squares.empty()) return;
+	vector<double> heights;
+	for (const square_t& sq : squares) heights.push_back(cv::boundingRect(sq).height);
+	const double tolerance = median(heights) / 2;
+
+	// rows: runs of tops closer than the tolerance, then by x in each row
+	std::sort(squares.begin(), squares.end(), [](const square_t& a, const square_t& b) {
+		return cv::boundingRect(a).y < cv::boundingRect(b).y;
+	});
+	size_t rowStart = 0;
+	for (size_t i = 1; i <= squares.size(); i++) {
+		if (i < squares.size() && cv::boundingRect(squares[i]).y - cv::boundingRect(squares[rowStart]).y < tolerance) continue;
+		std::sort(squares.begin() + rowStart, squares.begin() + i, [](const square_t& a, const square_t& b) {
+			return cv::boundingRect(a).x < cv::boundingRect(b).x;
+		});
+		rowStart = i;
+	}
+}
+
+struct MinOp {
+	uchar operator()(uchar a, uchar b) const { return a < b ? a : b; }
+};
+
+struct MaxOp {
+	uchar operator()(uchar a, uchar b) const { return a > b ? a : b; }
+};
+
+// van Herk/Gil-Werman running op over len rows: dst(y, x) = op of src(y - offset .. y - offset + len - 1, x),
+// rows out of the image are neutral. Prefix (g) and suffix (h) ops of blocks of len rows,
+// 3 ops per pixel whatever len; every step combines whole rows, which the compiler vectorizes.
+template <class Op>
+static void runningRows(const cv::Mat& src, cv::Mat& dst, int len, int offset, Op op, uchar neutral) {
+	const int n = src.rows, width = src.cols, r = offset;
+	const int padded = n + len - 1;
+	vector<uchar> neutralRow(width, neutral);
+	auto in = [&](int i) { int y = i - r; return y >= 0 && y < n ? src.ptr<uchar>(y) : neutralRow.data(); };
+
+	cv::Mat g(padded, width, CV_8U), h(padded, width, CV_8U);
+	for (int i = 0; i < padded; i++) {
+		const uchar* p = in(i);
+		uchar* gi = g.ptr<uchar>(i);
+		if (i % len == 0) std::copy(p, p + width, gi);
+		else {
+			const uchar* prev = g.ptr<uchar>(i - 1);
+			for (int x = 0; x < width; x++) gi[x] = op(prev[x], p[x]);
+		}
+	}
+	for (int i = padded - 1; i >= 0; i--) {
+		const uchar* p = in(i);
+		uchar* hi = h.ptr<uchar>(i);
+		if ((i + 1) % len == 0 || i == padded - 1) std::copy(p, p + width, hi);
+		else {
+			const uchar* next = h.ptr<uchar>(i + 1);
+			for (int x = 0; x < width; x++) hi[x] = op(next[x], p[x]);
+		}
+	}
+
+	dst.create(n, width, CV_8U);
+	for (int y = 0; y < n; y++) {
+		const uchar* hy = h.ptr<uchar>(y);
+		const uchar* gy = g.ptr<uchar>(y + len - 1);
+		uchar* d = dst.ptr<uchar>(y);
+		for (int x = 0; x < width; x++) d[x] = op(hy[x], gy[x]);
+	}
+}
+
+void openLines(const cv::Mat& binary, cv::Mat& lines, int length, bool horizontal) {
+	CV_Assert(binary.type() == CV_8U);
+	if (length < 2) {
+		binary.copyTo(lines);
+		return;
+	}
+	// the running ops go along the rows: a horizontal opening works on the transposed mask
+	cv::Mat src;
+	if (horizontal) cv::transpose(binary, src);
+	else src = binary;
+
+	// the dilation uses the reflected window, so that an even length opening doesn't shift the lines:
+	// a pixel is kept when one of the length windows covering it is all ink
+	cv::Mat eroded, opened;
+	runningRows(src, eroded, length, length / 2, MinOp(), 255);
+	runningRows(eroded, opened, length, length - 1 - length / 2, MaxOp(), 0);
+
+	if (horizontal) cv::transpose(opened, lines);
+	else lines = opened;
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "gridCells.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+// a printed line: positions [start, end] across it
+struct GridLine {
+	int start, end;
+};
+
+// runs of the projection over minCoverage of its maximum
+static vector<GridLine> findLines(const vector<int>& projection, double minCoverage)
+{
+	vector<GridLine> lines;
+	if (projection.empty()) return lines;
+	int threshold = (int)(minCoverage * *max_element(projection.begin(), projection.end()));
+	if (threshold <= 0) return lines;
+
+	for (int i = 0; i < (int)projection.size(); i++)
+	{
+		if (projection[i] < threshold) continue;
+		if (!lines.empty() && lines.back().end == i - 1) lines.back().end = i;
+		else lines.push_back({ i, i });
+	}
+	return lines;
+}
+
+// part of mask along a segment of a line, from row (or column) start to end
+static double coverage(const cv::Mat& mask, const GridLine& line, int from, int to, bool horizontal)
+{
+	if (to <= from) return 0;
+	int covered = 0;
+	for (int i = from; i < to; i++)
+	{
+		// covered when the line has ink at i, anywhere across its thickness
+		for (int j = line.start; j <= line.end; j++)
+		{
+			uchar v = horizontal ? mask.at<uchar>(j, i) : mask.at<uchar>(i, j);
+			if (v) { covered++; break; }
+		}
+	}
+	return (double)covered / (to - from);
+}
+
+void findGridCellsLines(const cv::Mat& image, vector<square_t>& squares, const DetectionConfig& config)
+{
+	TRACE_SCOPE("findGridCellsLines");
+	squares.clear();
+
+	cv::Mat ink, horizontal, vertical;
+	binarizeInk(image, ink);
+	int length = max(2, cvRound(config.minLineLength));
+	{
+		TRACE_SCOPE("openLines");
+		openLines(ink, horizontal, length, true);
+		openLines(ink, vertical, length, false);
+	}
+
+	// projections: ink of the horizontal lines per row, of the vertical lines per column
+	vector<int> rowSums(image.rows, 0), columnSums(image.cols, 0);
+	for (int y = 0; y < image.rows; y++)
+	{
+		const uchar* h = horizontal.ptr<uchar>(y);
+		const uchar* v = vertical.ptr<uchar>(y);
+		int sum = 0;
+		for (int x = 0; x < image.cols; x++)
+		{
+			sum += h[x] != 0;
+			columnSums[x] += v[x] != 0;
+		}
+		rowSums[y] = sum;
+	}
+	vector<GridLine> rows = findLines(rowSums, config.minLineCoverage);
+	vector<GridLine> columns = findLines(columnSums, config.minLineCoverage);
+	Tracer::counter("horizontal lines", rows.size());
+	Tracer::counter("vertical lines", columns.size());
+
+	// a cell between two consecutive lines each way, when its four sides are printed
+	for (size_t i = 0; i + 1 < rows.size(); i++)
+	{
+		int top = rows[i].end + 1, bottom = rows[i + 1].start;
+		for (size_t j = 0; j + 1 < columns.size(); j++)
+		{
+			int left = columns[j].end + 1, right = columns[j + 1].start;
+			if ((double)(right - left) * (bottom - top) <= config.minContourArea) continue;
+			if (coverage(horizontal, rows[i], left, right, true) < config.minLineCoverage
+				|| coverage(horizontal, rows[i + 1], left, right, true) < config.minLineCoverage
+				|| coverage(vertical, columns[j], top, bottom, false) < config.minLineCoverage
+				|| coverage(vertical, columns[j + 1], top, bottom, false) < config.minLineCoverage) continue;
+			squares.push_back(rectSquare(cv::Rect(left, top, right - left, bottom - top)));
+		}
+	}
+
+	keepRegularCells(squares, config.gridRegularity);
+	sortCellsByRow(squares);
+	Tracer::counter("squares found", squares.size());
+}
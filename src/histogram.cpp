@@ -1,94 +1,350 @@
+#include <algorithm>
+#include <mutex>
+
+#include "opencv2/core/utility.hpp"
 #include "opencv2/imgproc.hpp"
 #include "opencv2/highgui.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HISTOGRAM_SSE2 1
+#else
+#define HISTOGRAM_SSE2 0
+#endif
+
 #include "histogram.hpp"
+#include "trace.hpp"
 
 
-void computeHistogram(const string& histTitle,const Mat& img){
-	
-	// INIT		
-	int histSize = 255; // Number of bins
-	float range[] = { 0, 255 } ; // Range of pixel values
-  const float* histRange = { range };  
-	bool uniform = true; 
-	bool accumulate = false;	
-	//image conversion 
-	
-	cvtColor(img, img, COLOR_BGR2HSV);
-
-	// Number of histograms to compute (1: grayLevel or 3: BGR)
-	int numChannels = img.channels();
-  MatND* hist = new MatND[numChannels];
-	
-	// Split BRG if needed
-	vector<Mat> channels;
-	if(numChannels==3) split(img,channels);
-	else channels.push_back(img);
-
-
-	//Seuillage
-	//threshold(channels[1], channels[1], 128.0, 128.0, THRESH_BINARY);
-
-	//Region of interest
-
-	// Setup a rectangle to define your region of interest
-	cv::Rect myROI(10, 10, 100, 100);
-
-	// Crop the full image to that image contained by the rectangle myROI
-	// Note that this doesn't copy the data
-	cv::Mat croppedImage = img(myROI);
-	imshow("image dcoupe", croppedImage);
-	imwrite("C:/Users/sbeaulie/Desktop/Projet OpenCV-CMake/images/img.png", croppedImage);
-
-	// COMPUTE
-	int zero=0;
-	for(int idxChannel=0; idxChannel<numChannels; idxChannel++){
-		calcHist( &channels[idxChannel], 1, &zero, Mat(), hist[idxChannel], 1, &histSize, &histRange, uniform, accumulate );
+// adds the pixels of rows [begin, end) to local, channel c in local[c * bins + bin]
+static void accumulateRows(const Mat& img, int begin, int end, const uchar* binOf, int bins, vector<uint32_t>& local) {
+	const int numChannels = img.channels();
+	const int width = img.cols * numChannels;
+	uint32_t* counts = local.data();
+
+	for (int y = begin; y < end; y++) {
+		const uchar* p = img.ptr<uchar>(y);
+		int x = 0;
+		if (numChannels == 3) {
+			// the channels of a pixel go to different tables: no dependency between the 3 increments
+			uint32_t* c0 = counts;
+			uint32_t* c1 = counts + bins;
+			uint32_t* c2 = counts + 2 * bins;
+			for (; x + 6 <= width; x += 6) {
+				c0[binOf[p[x]]]++; c1[binOf[p[x + 1]]]++; c2[binOf[p[x + 2]]]++;
+				c0[binOf[p[x + 3]]]++; c1[binOf[p[x + 4]]]++; c2[binOf[p[x + 5]]]++;
+			}
+		}
+		else if (numChannels == 1) {
+			// two tables for the same channel, merged at the end, break the dependency
+			// between consecutive equal pixels
+			uint32_t* c1 = counts + bins;
+			for (; x + 4 <= width; x += 4) {
+				counts[binOf[p[x]]]++; c1[binOf[p[x + 1]]]++;
+				counts[binOf[p[x + 2]]]++; c1[binOf[p[x + 3]]]++;
+			}
+		}
+		for (; x < width; x++) {
+			counts[(x % numChannels) * bins + binOf[p[x]]]++;
+		}
 	}
+}
 
-	// DISPLAY
-	int hist_w = 1000; int hist_h = 600; // Size of the histogram's image
-  int bin_w = cvRound( (double)hist_w/(double)histSize ); // Width of a bin
-  Mat histImage( hist_h, hist_w, CV_8UC3, CV_RGB( 0,0,0) );
-	
-	Point pt1, pt2;
-	Scalar color;
-	double scale, max;
-
-	// For each channel
-	for(int idxChannel=0; idxChannel<numChannels; idxChannel++){
-		// Scale value
-		minMaxLoc(hist[idxChannel],0,&max,0,0);
-		scale = (double)hist_h/(max+500);
+ChannelHistograms computeChannelHistograms(const Mat& img, int bins) {
+	TRACE_SCOPE("computeChannelHistograms");
+	CV_Assert(img.depth() == CV_8U && img.channels() <= 4);
+	bins = std::max(1, std::min(bins, 256));
 
-		// Color of the line (B G R or white)
-		if(numChannels==1)
-			color = CV_RGB(255,255,255); // White
-		else{
-			if(idxChannel == 0) color = CV_RGB(0,0,255); // Blue
-			else if(idxChannel == 1) color = CV_RGB(0,255,0); // Green
-			else color = CV_RGB(255,0,0); // Red
+	const int numChannels = img.channels();
+	// the single channel kernel uses a second table
+	const int tables = numChannels == 1 ? 2 : numChannels;
+
+	uchar binOf[256];
+	for (int v = 0; v < 256; v++) binOf[v] = (uchar)(v * bins / 256);
+
+	vector<uint32_t> total(tables * bins, 0);
+	std::mutex mutex;
+	parallel_for_(Range(0, img.rows), [&](const Range& rows) {
+		vector<uint32_t> local(tables * bins, 0);
+		accumulateRows(img, rows.start, rows.end, binOf, bins, local);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < total.size(); i++) total[i] += local[i];
+	});
+
+	ChannelHistograms hist;
+	hist.bins = bins;
+	hist.counts.resize(numChannels);
+	for (int c = 0; c < numChannels; c++) {
+		hist.counts[c].assign(total.begin() + c * bins, total.begin() + (c + 1) * bins);
+	}
+	if (numChannels == 1) {
+		for (int b = 0; b < bins; b++) hist.counts[0][b] += total[bins + b];
+	}
+	return hist;
+}
+
+// fixed point divisions of the 8 bit BGR to HSV conversion of OpenCV
+static const int hsvShift = 12;
+
+struct HsvTables {
+	int sdiv[256]; // (255 << hsvShift) / v
+	int hdiv[256]; // (180 << hsvShift) / (6 * diff)
+
+	HsvTables() {
+		sdiv[0] = hdiv[0] = 0;
+		for (int i = 1; i < 256; i++) {
+			sdiv[i] = cvRound((255 << hsvShift) / (1. * i));
+			hdiv[i] = cvRound((180 << hsvShift) / (6. * i));
 		}
+	}
+};
+
+// counts the HSV values of count pixels, channel c in local[c * 256 + bin]
+static void accumulateHsvPixels(const uchar* p, int count, const HsvTables& tables, const uchar* binOf, uint32_t* local) {
+	uint32_t* hCounts = local;
+	uint32_t* sCounts = local + 256;
+	uint32_t* vCounts = local + 512;
+	const int round = 1 << (hsvShift - 1);
+
+	for (int x = 0; x < count; x++, p += 3) {
+		// branch free, as cvtColor
+		int b = p[0], g = p[1], r = p[2];
+		int v = std::max(b, std::max(g, r));
+		int vmin = std::min(b, std::min(g, r));
+		int diff = v - vmin;
+		int vr = v == r ? -1 : 0;
+		int vg = v == g ? -1 : 0;
 
-		// For each bin
-		for( int idxBin = 1; idxBin < histSize; idxBin++ ){ 
-
-			// Draw a line						
-			pt1 = Point( bin_w*(idxBin-1), cvRound( float(hist_h) - (hist[idxChannel].at<float>(idxBin-1))*scale) );
-			pt2 = Point( bin_w*(idxBin), cvRound( float(hist_h) - (hist[idxChannel].at<float>(idxBin))*scale) );
-      line( histImage,  pt1 , pt2, color, 2, 8, 0  ); 
-      
-			/*
-			line( histImage, 
-						Point( bin_w*idxBin, hist_h ) , 
-						Point( bin_w*idxBin, hist_h - cvRound(hist[idxChannel].at<float>(idxBin)) ), 
-						CV_RGB(255,255,255));
-			*/
-		}   
+		int s = (diff * tables.sdiv[v] + round) >> hsvShift;
+		int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+		h = (h * tables.hdiv[diff] + round) >> hsvShift;
+		h += h < 0 ? 180 : 0;
+
+		hCounts[binOf[h]]++;
+		sCounts[binOf[s]]++;
+		vCounts[binOf[v]]++;
 	}
-	imshow(histTitle, histImage);
+}
+
+#if HISTOGRAM_SSE2
+// splits 16 interleaved 3 channel pixels into their channels
+static inline void deinterleave(const uchar* p, __m128i& c0, __m128i& c1, __m128i& c2) {
+	__m128i t00 = _mm_loadu_si128((const __m128i*)p);
+	__m128i t01 = _mm_loadu_si128((const __m128i*)(p + 16));
+	__m128i t02 = _mm_loadu_si128((const __m128i*)(p + 32));
+
+	__m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+	__m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+	__m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+	__m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+	__m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+	__m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+	__m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+	__m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+	__m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+	c0 = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+	c1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+	c2 = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+}
+
+// 32 bit a * b, SSE2 only multiplies the even lanes
+static inline __m128i mullo32(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// h and s of 4 pixels from v, diff and the h numerator
+static inline void hueSaturation4(__m128i v, __m128i diff, __m128i hNum, __m128i& h, __m128i& s) {
+	const __m128i round = _mm_set1_epi32(1 << (hsvShift - 1));
+	// a float division rounded to nearest gives exactly the sdiv and hdiv tables, without the gathers;
+	// a zero divisor gives garbage multiplied by a zero diff or h numerator
+	__m128i sdiv = _mm_cvtps_epi32(_mm_div_ps(_mm_set1_ps(255 << hsvShift), _mm_cvtepi32_ps(v)));
+	__m128i hdiv = _mm_cvtps_epi32(_mm_div_ps(_mm_set1_ps((180 << hsvShift) / 6), _mm_cvtepi32_ps(diff)));
+
+	s = _mm_srai_epi32(_mm_add_epi32(mullo32(diff, sdiv), round), hsvShift);
+	h = _mm_srai_epi32(_mm_add_epi32(mullo32(hNum, hdiv), round), hsvShift);
+	h = _mm_add_epi32(h, _mm_and_si128(_mm_cmplt_epi32(h, _mm_setzero_si128()), _mm_set1_epi32(180)));
+}
+
+// h and s of 8 pixels given as 16 bit lanes
+static inline void hueSaturation8(__m128i v, __m128i diff, __m128i hNum, __m128i& h, __m128i& s) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i h0, s0, h1, s1;
+	hueSaturation4(_mm_unpacklo_epi16(v, zero), _mm_unpacklo_epi16(diff, zero),
+		_mm_srai_epi32(_mm_unpacklo_epi16(hNum, hNum), 16), h0, s0);
+	hueSaturation4(_mm_unpackhi_epi16(v, zero), _mm_unpackhi_epi16(diff, zero),
+		_mm_srai_epi32(_mm_unpackhi_epi16(hNum, hNum), 16), h1, s1);
+	h = _mm_packs_epi32(h0, h1);
+	s = _mm_packs_epi32(s0, s1);
+}
+
+// the branch free h numerator of the scalar kernel on 16 bit lanes, vr and vg are all ones masks
+static inline __m128i hueNumerator(__m128i b, __m128i g, __m128i r, __m128i diff, __m128i vr, __m128i vg) {
+	__m128i diff2 = _mm_add_epi16(diff, diff);
+	__m128i fromG = _mm_add_epi16(_mm_sub_epi16(b, r), diff2);
+	__m128i fromB = _mm_add_epi16(_mm_sub_epi16(r, g), _mm_add_epi16(diff2, diff2));
+	__m128i notR = _mm_add_epi16(_mm_and_si128(vg, fromG), _mm_andnot_si128(vg, fromB));
+	return _mm_add_epi16(_mm_and_si128(vr, _mm_sub_epi16(g, b)), _mm_andnot_si128(vr, notR));
+}
 
-	//waitKey(0);
+// converts 16 pixels to h, s and v, stored as bytes
+static inline void convertHsv16(const uchar* p, uchar* h, uchar* s, uchar* v) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i b, g, r;
+	deinterleave(p, b, g, r);
+
+	__m128i vmax = _mm_max_epu8(b, _mm_max_epu8(g, r));
+	__m128i diff = _mm_sub_epi8(vmax, _mm_min_epu8(b, _mm_min_epu8(g, r)));
+	__m128i vr = _mm_cmpeq_epi8(vmax, r);
+	__m128i vg = _mm_cmpeq_epi8(vmax, g);
+
+	__m128i diffLo = _mm_unpacklo_epi8(diff, zero), diffHi = _mm_unpackhi_epi8(diff, zero);
+	__m128i hLo, sLo, hHi, sHi;
+	hueSaturation8(_mm_unpacklo_epi8(vmax, zero), diffLo,
+		hueNumerator(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(r, zero),
+			diffLo, _mm_unpacklo_epi8(vr, vr), _mm_unpacklo_epi8(vg, vg)), hLo, sLo);
+	hueSaturation8(_mm_unpackhi_epi8(vmax, zero), diffHi,
+		hueNumerator(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero),
+			diffHi, _mm_unpackhi_epi8(vr, vr), _mm_unpackhi_epi8(vg, vg)), hHi, sHi);
+
+	_mm_storeu_si128((__m128i*)h, _mm_packus_epi16(hLo, hHi));
+	_mm_storeu_si128((__m128i*)s, _mm_packus_epi16(sLo, sHi));
+	_mm_storeu_si128((__m128i*)v, vmax);
+}
+#endif
+
+// counts the HSV values of the pixels of rows [begin, end), channel c in local[c * 256 + bin]
+static void accumulateHsvRows(const Mat& bgr, int begin, int end, const HsvTables& tables, const uchar* binOf, uint32_t* local) {
+	for (int y = begin; y < end; y++) {
+		const uchar* p = bgr.ptr<uchar>(y);
+		int x = 0;
+#if HISTOGRAM_SSE2
+		// the conversion is vectorized, the counting stays scalar
+		uint32_t* hCounts = local;
+		uint32_t* sCounts = local + 256;
+		uint32_t* vCounts = local + 512;
+		uchar h[16], s[16], v[16];
+		for (; x + 16 <= bgr.cols; x += 16, p += 48) {
+			convertHsv16(p, h, s, v);
+			for (int i = 0; i < 16; i++) {
+				hCounts[binOf[h[i]]]++;
+				sCounts[binOf[s[i]]]++;
+				vCounts[binOf[v[i]]]++;
+			}
+		}
+#endif
+		accumulateHsvPixels(p, bgr.cols - x, tables, binOf, local);
+	}
+}
+
+void computeHsvHistograms(const Mat& bgr, ChannelHistograms& hist, int bins) {
+	TRACE_SCOPE("computeHsvHistograms");
+	CV_Assert(bgr.type() == CV_8UC3);
+	bins = std::max(1, std::min(bins, 256));
+	static const HsvTables tables;
+
+	uchar binOf[256];
+	for (int v = 0; v < 256; v++) binOf[v] = (uchar)(v * bins / 256);
+
+	// counted in 256 bins per channel, folded to bins by binOf
+	uint32_t total[3 * 256] = { 0 };
+	std::mutex mutex;
+	parallel_for_(Range(0, bgr.rows), [&](const Range& rows) {
+		uint32_t local[3 * 256] = { 0 };
+		accumulateHsvRows(bgr, rows.start, rows.end, tables, binOf, local);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int i = 0; i < 3 * 256; i++) total[i] += local[i];
+	});
+
+	hist.bins = bins;
+	hist.counts.resize(3);
+	for (int c = 0; c < 3; c++) hist.counts[c].assign(total + c * 256, total + c * 256 + bins);
+}
+
+ChannelHistograms computeHsvHistograms(const Mat& bgr, int bins) {
+	ChannelHistograms hist;
+	computeHsvHistograms(bgr, hist, bins);
+	return hist;
+}
+
+void addHistograms(ChannelHistograms& total, const ChannelHistograms& hist) {
+	if (total.channels() == 0) {
+		total = hist;
+		return;
+	}
+	CV_Assert(total.bins == hist.bins && total.channels() == hist.channels());
+	for (int c = 0; c < hist.channels(); c++) {
+		for (int b = 0; b < hist.bins; b++) total.counts[c][b] += hist.counts[c][b];
+	}
+}
+
+int otsuThreshold(const vector<uint32_t>& counts, double* separability) {
+	double total = 0, sum = 0;
+	for (size_t b = 0; b < counts.size(); b++) {
+		total += counts[b];
+		sum += (double)b * counts[b];
+	}
+	if (separability) *separability = 0;
+	if (total == 0) return 0;
+
+	double mean = sum / total, variance = 0;
+	for (size_t b = 0; b < counts.size(); b++) variance += counts[b] * (b - mean) * (b - mean);
+	variance /= total;
+
+	// maximizes the between class variance w0 * w1 * (m0 - m1)^2
+	double w0 = 0, sum0 = 0, best = -1;
+	int threshold = 0;
+	for (size_t b = 0; b + 1 < counts.size(); b++) {
+		w0 += counts[b];
+		sum0 += (double)b * counts[b];
+		double w1 = total - w0;
+		if (w0 == 0 || w1 == 0) continue;
+		double m0 = sum0 / w0, m1 = (sum - sum0) / w1;
+		double between = (w0 / total) * (w1 / total) * (m0 - m1) * (m0 - m1);
+		if (between > best) {
+			best = between;
+			threshold = (int)b + 1;
+		}
+	}
+	if (separability && variance > 0 && best > 0) *separability = best / variance;
+	return threshold;
+}
+
+Mat plotHistograms(const ChannelHistograms& hist, int width, int height) {
+	Mat histImage(height, width, CV_8UC3, CV_RGB(0, 0, 0));
+	if (hist.bins < 2) return histImage;
+	double binWidth = (double)width / hist.bins;
+
+	for (int idxChannel = 0; idxChannel < hist.channels(); idxChannel++) {
+		const vector<uint32_t>& counts = hist.counts[idxChannel];
+		uint32_t max = *std::max_element(counts.begin(), counts.end());
+		double scale = (double)height / (max + 500);
+
+		// Color of the line (B G R or white)
+		Scalar color;
+		if (hist.channels() == 1)
+			color = CV_RGB(255, 255, 255); // White
+		else {
+			if (idxChannel == 0) color = CV_RGB(0, 0, 255); // Blue
+			else if (idxChannel == 1) color = CV_RGB(0, 255, 0); // Green
+			else color = CV_RGB(255, 0, 0); // Red
+		}
+
+		for (int idxBin = 1; idxBin < hist.bins; idxBin++) {
+			Point pt1(cvRound(binWidth * (idxBin - 1)), cvRound(height - counts[idxBin - 1] * scale));
+			Point pt2(cvRound(binWidth * idxBin), cvRound(height - counts[idxBin] * scale));
+			line(histImage, pt1, pt2, color, 2, 8, 0);
+		}
+	}
+	return histImage;
+}
 
-	delete[]hist;
-}
\ No newline at end of file
+void computeHistogram(const string& histTitle, const Mat& img) {
+	imshow(histTitle, plotHistograms(computeHsvHistograms(img)));
+}
@@ -0,0 +1,82 @@
+#include <algorithm>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "inkStats.hpp"
+#include "trace.hpp"
+
+
+InkIntegral::InkIntegral(const cv::Mat& image, const cv::Rect& zone)
+	: area(zone & cv::Rect(0, 0, image.cols, image.rows)) {
+	TRACE_SCOPE("inkIntegral", "rows", area.height);
+	cv::Mat gray, ink;
+	if (image.channels() == 3) cv::cvtColor(image(area), gray, cv::COLOR_BGR2GRAY);
+	else gray = image(area);
+	cv::threshold(gray, ink, 0, 1, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+	// one pass for the three integrals, unsigned arithmetic wraps around
+	count.create(area.height + 1, area.width + 1, CV_32S);
+	sumX.create(area.height + 1, area.width + 1, CV_32S);
+	sumY.create(area.height + 1, area.width + 1, CV_32S);
+	std::fill(count.ptr<uint32_t>(0), count.ptr<uint32_t>(0) + count.cols, 0u);
+	std::fill(sumX.ptr<uint32_t>(0), sumX.ptr<uint32_t>(0) + sumX.cols, 0u);
+	std::fill(sumY.ptr<uint32_t>(0), sumY.ptr<uint32_t>(0) + sumY.cols, 0u);
+
+	for (int y = 0; y < area.height; y++) {
+		const uchar* p = ink.ptr<uchar>(y);
+		const uint32_t* c0 = count.ptr<uint32_t>(y);
+		const uint32_t* x0 = sumX.ptr<uint32_t>(y);
+		const uint32_t* y0 = sumY.ptr<uint32_t>(y);
+		uint32_t* c1 = count.ptr<uint32_t>(y + 1);
+		uint32_t* x1 = sumX.ptr<uint32_t>(y + 1);
+		uint32_t* y1 = sumY.ptr<uint32_t>(y + 1);
+		uint32_t rowCount = 0, rowX = 0, rowY = 0;
+		c1[0] = x1[0] = y1[0] = 0;
+		for (int x = 0; x < area.width; x++) {
+			if (p[x]) {
+				rowCount++;
+				rowX += (uint32_t)x;
+				rowY += (uint32_t)y;
+			}
+			c1[x + 1] = c0[x + 1] + rowCount;
+			x1[x + 1] = x0[x + 1] + rowX;
+			y1[x + 1] = y0[x + 1] + rowY;
+		}
+	}
+}
+
+uint32_t InkIntegral::rectSum(const cv::Mat& integral, int x, int y, int width, int height) const {
+	return integral.at<uint32_t>(y + height, x + width) - integral.at<uint32_t>(y, x + width)
+		- integral.at<uint32_t>(y + height, x) + integral.at<uint32_t>(y, x);
+}
+
+InkStats InkIntegral::cellStats(const cv::Rect& rect, double margin) const {
+	InkStats stats;
+	int dx = cvRound(rect.width * margin), dy = cvRound(rect.height * margin);
+	cv::Rect inner = cv::Rect(rect.x + dx, rect.y + dy, rect.width - 2 * dx, rect.height - 2 * dy) & area;
+	if (inner.width <= 0 || inner.height <= 0) return stats;
+
+	// from here, coordinates in the integrals
+	int x = inner.x - area.x, y = inner.y - area.y, w = inner.width, h = inner.height;
+	uint32_t ink = rectSum(count, x, y, w, h);
+	stats.ratio = (double)ink / ((double)w * h);
+	if (ink == 0) return stats;
+
+	// centre of mass, then from the corner of the cell
+	stats.center.x = (float)((double)rectSum(sumX, x, y, w, h) / ink + area.x - rect.x);
+	stats.center.y = (float)((double)rectSum(sumY, x, y, w, h) / ink + area.y - rect.y);
+
+	// first column with ink: smallest width of the left part holding some ink, and so on
+	int lo, hi;
+	for (lo = 1, hi = w; lo < hi;) { int m = (lo + hi) / 2; if (rectSum(count, x, y, m, h) > 0) hi = m; else lo = m + 1; }
+	int left = lo - 1;
+	for (lo = 1, hi = w; lo < hi;) { int m = (lo + hi) / 2; if (rectSum(count, x + w - m, y, m, h) > 0) hi = m; else lo = m + 1; }
+	int right = w - lo;
+	for (lo = 1, hi = h; lo < hi;) { int m = (lo + hi) / 2; if (rectSum(count, x, y, w, m) > 0) hi = m; else lo = m + 1; }
+	int top = lo - 1;
+	for (lo = 1, hi = h; lo < hi;) { int m = (lo + hi) / 2; if (rectSum(count, x, y + h - m, w, m) > 0) hi = m; else lo = m + 1; }
+	int bottom = h - lo;
+
+	stats.box = cv::Rect(inner.x - rect.x + left, inner.y - rect.y + top, right - left + 1, bottom - top + 1);
+	return stats;
+}
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstring>
+
+#ifdef SQUARES_IO_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "ioRing.hpp"
+
+#ifndef SQUARES_IO_URING
+
+IoRing::IoRing(unsigned) : ringFd(-1) {
+}
+
+IoRing::~IoRing() {
+}
+
+bool IoRing::writeFiles(std::vector<FileWrite>&) {
+	return false;
+}
+
+#else
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+template <class T>
+static T* at(void* base, unsigned offset) {
+	return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+IoRing::IoRing(unsigned requested)
+	: ringFd(-1), entries(0), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0), cqRingSize(0),
+	sqes(MAP_FAILED), sqesSize(0) {
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	ringFd = (int)syscall(__NR_io_uring_setup, requested, &params);
+	if (ringFd < 0) return;
+	entries = params.sq_entries;
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	cqRing = single ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+		close();
+		return;
+	}
+
+	sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+	sqMask = at<unsigned>(sqRing, params.sq_off.ring_mask);
+	sqArray = at<unsigned>(sqRing, params.sq_off.array);
+	cqHead = at<unsigned>(cqRing, params.cq_off.head);
+	cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+	cqMask = at<unsigned>(cqRing, params.cq_off.ring_mask);
+	cqes = at<void>(cqRing, params.cq_off.cqes);
+}
+
+IoRing::~IoRing() {
+	close();
+}
+
+void IoRing::close() {
+	if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+	if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+	if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+	sqes = cqRing = sqRing = MAP_FAILED;
+	if (ringFd >= 0) ::close(ringFd);
+	ringFd = -1;
+}
+
+void* IoRing::nextEntry(unsigned& tail) {
+	unsigned index = tail & *sqMask;
+	io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+	std::memset(sqe, 0, sizeof(*sqe));
+	sqArray[index] = index;
+	tail++;
+	return sqe;
+}
+
+bool IoRing::submitAndWait(unsigned submitted, unsigned count, std::vector<int>& results) {
+	// the kernel reads the entries once it sees the new tail
+	__atomic_store_n(sqTail, *sqTail + submitted, __ATOMIC_RELEASE);
+
+	unsigned reaped = 0;
+	while (reaped < count) {
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, reaped++) {
+			const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes) + (head & *cqMask);
+			results[(size_t)cqe->user_data] = cqe->res;
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		if (reaped == count) break;
+
+		int done = (int)syscall(__NR_io_uring_enter, ringFd, submitted, count - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (done < 0 && errno != EINTR) return false;
+		if (done >= 0) submitted = 0;
+	}
+	return true;
+}
+
+bool IoRing::writeFiles(std::vector<FileWrite>& writes) {
+	if (ringFd < 0) return false;
+
+	// a file takes one entry to open, then two (write linked to close)
+	const size_t chunk = entries / 2;
+	for (size_t first = 0; first < writes.size(); first += chunk) {
+		size_t count = std::min(chunk, writes.size() - first);
+
+		std::vector<int> fds(count);
+		unsigned tail = *sqTail;
+		for (size_t i = 0; i < count; i++) {
+			io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry(tail));
+			sqe->opcode = IORING_OP_OPENAT;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (unsigned long)writes[first + i].path;
+			sqe->len = 0644;
+			sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+			sqe->user_data = i;
+		}
+		if (!submitAndWait((unsigned)count, (unsigned)count, fds)) {
+			close();
+			return false;
+		}
+		if (first == 0 && fds[0] == -EINVAL) {
+			// kernel older than 5.6: no openat through the ring, nothing was created
+			for (size_t i = 1; i < count; i++) if (fds[i] >= 0) ::close(fds[i]);
+			close();
+			return false;
+		}
+
+		std::vector<int> results(2 * count, 0);
+		tail = *sqTail;
+		unsigned submitted = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (fds[i] < 0) continue;
+			FileWrite& write = writes[first + i];
+			io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry(tail));
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->flags = IOSQE_IO_LINK;
+			sqe->fd = fds[i];
+			sqe->addr = (unsigned long)write.data;
+			sqe->len = (unsigned)write.size;
+			sqe->off = 0;
+			sqe->user_data = 2 * i;
+			sqe = static_cast<io_uring_sqe*>(nextEntry(tail));
+			sqe->opcode = IORING_OP_CLOSE;
+			sqe->fd = fds[i];
+			sqe->user_data = 2 * i + 1;
+			submitted += 2;
+		}
+		if (submitted > 0 && !submitAndWait(submitted, submitted, results)) {
+			for (size_t i = 0; i < count; i++) if (fds[i] >= 0) ::close(fds[i]);
+			close();
+			return false;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			FileWrite& write = writes[first + i];
+			if (fds[i] < 0) {
+				write.result = fds[i];
+				continue;
+			}
+			int written = results[2 * i], closed = results[2 * i + 1];
+			// a failed or short write cancels the linked close
+			if (closed == -ECANCELED) closed = ::close(fds[i]) == 0 ? 0 : -errno;
+			if (written < 0) write.result = written;
+			else if ((size_t)written != write.size) write.result = -EIO;
+			else write.result = closed < 0 ? closed : written;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,228 @@
+#include <iostream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "manifestWriter.hpp"
+#include "trace.hpp"
+
+static std::atomic<uint64_t> nextManifestId(1);
+
+static const char* csvHeader = "label,size,form,scripter,page,row,column,output";
+static const char* csvInkHeader = ",ink,ink_x,ink_y,ink_width,ink_height,ink_center_x,ink_center_y";
+
+static std::string formatFloat(float value) {
+	char text[32];
+	std::snprintf(text, sizeof(text), "%g", value);
+	return text;
+}
+
+static void appendCsvField(std::string& out, const std::string& field) {
+	if (field.find_first_of(",\"\r\n") == std::string::npos) {
+		out += field;
+		return;
+	}
+	out += '"';
+	for (char c : field) {
+		if (c == '"') out += '"';
+		out += c;
+	}
+	out += '"';
+}
+
+static void appendJsonString(std::string& out, const std::string& s) {
+	static const char* hex = "0123456789abcdef";
+	out += '"';
+	for (char c : s) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				out += "\\u00";
+				out += hex[(c >> 4) & 0xF];
+				out += hex[c & 0xF];
+			}
+			else out += c;
+		}
+	}
+	out += '"';
+}
+
+// first line of a file without its end of line, empty for a missing or empty file
+static std::string readFirstLine(const std::string& path) {
+	std::string line;
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == NULL) return line;
+	int c;
+	while ((c = std::fgetc(file)) != EOF && c != '\n') line += (char)c;
+	std::fclose(file);
+	if (!line.empty() && line.back() == '\r') line.pop_back();
+	return line;
+}
+
+
+ManifestWriter::ManifestWriter(size_t flushBytes, uint64_t checkpointRows)
+	: flushBytes(flushBytes), checkpointRows(checkpointRows), id(nextManifestId++),
+	format(CSV), inkColumns(false), file(NULL), failed(false), rowCount(0) {
+}
+
+ManifestWriter::~ManifestWriter() {
+	close();
+}
+
+ManifestWriter::Format ManifestWriter::formatFromPath(const std::string& path) {
+	size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+	return extension == ".jsonl" || extension == ".json" ? JSON_LINES : CSV;
+}
+
+bool ManifestWriter::open(const std::string& path, Format manifestFormat, bool withInk) {
+	close();
+	format = manifestFormat;
+	inkColumns = withInk;
+	failed = false;
+	rowCount = 0;
+
+	std::string header = csvHeader;
+	if (inkColumns) header += csvInkHeader;
+	if (format == CSV) {
+		// rows of a run with or without the ink columns can't follow the others
+		std::string existing = readFirstLine(path);
+		if (!existing.empty() && existing != header) {
+			std::cerr << "ManifestWriter: the columns of " << path << " differ from the ones of this run, "
+				<< "use another manifest" << std::endl;
+			return false;
+		}
+	}
+
+	file = std::fopen(path.c_str(), "ab");
+	if (file == NULL) return false;
+
+	std::fseek(file, 0, SEEK_END);
+	if (format == CSV && std::ftell(file) == 0) {
+		header += '\n';
+		writeOut(header);
+	}
+	return true;
+}
+
+ManifestWriter::LocalBuffer& ManifestWriter::localBuffer() {
+	// buffer of the calling thread for each manifest
+	thread_local std::unordered_map<uint64_t, LocalBuffer*> cache;
+
+	auto it = cache.find(id);
+	if (it != cache.end()) return *it->second;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffers.push_back(std::unique_ptr<LocalBuffer>(new LocalBuffer()));
+	LocalBuffer* buffer = buffers.back().get();
+	buffer->data.reserve(flushBytes + 512);
+	cache[id] = buffer;
+	return *buffer;
+}
+
+void ManifestWriter::addRow(const CellInfo& cell, const std::string& output) {
+	LocalBuffer& buffer = localBuffer();
+	{
+		std::lock_guard<std::mutex> lock(buffer.mutex); // only contended by checkpoints
+		formatRow(buffer.data, cell, output);
+		if (buffer.data.size() >= flushBytes) writeOut(buffer.data);
+	}
+
+	uint64_t row = ++rowCount;
+	if (checkpointRows > 0 && row % checkpointRows == 0) checkpoint();
+}
+
+void ManifestWriter::formatRow(std::string& out, const CellInfo& cell, const std::string& output) const {
+	if (format == CSV) {
+		appendCsvField(out, cell.label); out += ',';
+		appendCsvField(out, cell.size); out += ',';
+		appendCsvField(out, cell.scripter + cell.page); out += ',';
+		appendCsvField(out, cell.scripter); out += ',';
+		appendCsvField(out, cell.page); out += ',';
+		out += std::to_string(cell.row); out += ',';
+		out += std::to_string(cell.column); out += ',';
+		appendCsvField(out, output);
+		if (inkColumns) {
+			// empty fields when the cell wasn't measured
+			out += ',';
+			if (cell.inkRatio >= 0) {
+				out += formatFloat(cell.inkRatio); out += ',';
+				out += std::to_string(cell.inkX); out += ',';
+				out += std::to_string(cell.inkY); out += ',';
+				out += std::to_string(cell.inkWidth); out += ',';
+				out += std::to_string(cell.inkHeight); out += ',';
+				out += formatFloat(cell.inkCenterX); out += ',';
+				out += formatFloat(cell.inkCenterY);
+			}
+			else out += ",,,,,,";
+		}
+		out += '\n';
+		return;
+	}
+
+	out += "{\"label\":"; appendJsonString(out, cell.label);
+	out += ",\"size\":"; appendJsonString(out, cell.size);
+	out += ",\"form\":"; appendJsonString(out, cell.scripter + cell.page);
+	out += ",\"scripter\":"; appendJsonString(out, cell.scripter);
+	out += ",\"page\":"; appendJsonString(out, cell.page);
+	out += ",\"row\":"; out += std::to_string(cell.row);
+	out += ",\"column\":"; out += std::to_string(cell.column);
+	out += ",\"output\":"; appendJsonString(out, output);
+	if (cell.inkRatio >= 0) {
+		out += ",\"ink\":"; out += formatFloat(cell.inkRatio);
+		out += ",\"ink_box\":[" + std::to_string(cell.inkX) + "," + std::to_string(cell.inkY) + ","
+			+ std::to_string(cell.inkWidth) + "," + std::to_string(cell.inkHeight) + "]";
+		out += ",\"ink_center\":[" + formatFloat(cell.inkCenterX) + "," + formatFloat(cell.inkCenterY) + "]";
+	}
+	out += "}\n";
+}
+
+// writes data in one call and empties it
+void ManifestWriter::writeOut(std::string& data) {
+	std::lock_guard<std::mutex> lock(fileMutex);
+	if (file != NULL && !data.empty()) {
+		if (std::fwrite(data.data(), 1, data.size(), file) != data.size()) failed = true;
+	}
+	data.clear();
+}
+
+bool ManifestWriter::checkpoint() {
+	TRACE_SCOPE("manifestCheckpoint");
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		for (auto& buffer : buffers) {
+			std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+			writeOut(buffer->data);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(fileMutex);
+	if (file == NULL) return false;
+	if (std::fflush(file) != 0) failed = true;
+#ifdef _WIN32
+	if (_commit(_fileno(file)) != 0) failed = true;
+#else
+	if (fsync(fileno(file)) != 0) failed = true;
+#endif
+	return !failed;
+}
+
+bool ManifestWriter::close() {
+	if (file == NULL) return true;
+
+	bool ok = checkpoint();
+	std::lock_guard<std::mutex> lock(fileMutex);
+	ok = std::fclose(file) == 0 && ok;
+	file = NULL;
+	if (!ok) std::cerr << "ManifestWriter: write error" << std::endl;
+	return ok;
+}
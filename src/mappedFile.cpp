@@ -0,0 +1,109 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedFile.hpp"
+
+
+MappedFile::MappedFile() : opened(false), bytes(NULL), length(0) {
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+	opened = true;
+	if (length == 0) return true; // an empty file can't be mapped
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle != NULL) {
+		bytes = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (bytes == NULL) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::willNeed() const {
+}
+
+void MappedFile::close() {
+	if (bytes != NULL) UnmapViewOfFile(bytes);
+	if (mappingHandle != NULL) CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+	bytes = NULL;
+	length = 0;
+	opened = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	length = (size_t)st.st_size;
+	opened = true;
+
+	if (length > 0) {
+		void* address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED) {
+			::close(fd);
+			close();
+			return false;
+		}
+		bytes = (const unsigned char*)address;
+	}
+
+	// the mapping stays valid once the descriptor is closed
+	::close(fd);
+	return true;
+}
+
+void MappedFile::willNeed() const {
+	if (bytes != NULL) madvise((void*)bytes, length, MADV_WILLNEED);
+}
+
+void MappedFile::close() {
+	if (bytes != NULL) munmap((void*)bytes, length);
+	bytes = NULL;
+	length = 0;
+	opened = false;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <fstream>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "opencv2/imgcodecs.hpp"
+
+#include "hashing.hpp"
+#include "mappedFile.hpp"
+#include "pageLoader.hpp"
+#include "trace.hpp"
+
+
+PageLoader::PageLoader(const std::vector<std::string>& paths, int readAhead)
+	: paths(paths), position(0), advised(0), readAhead(readAhead > 0 ? readAhead : 0), hashContent(false) {
+}
+
+bool PageLoader::next(LoadedPage& page) {
+	if (position >= paths.size()) return false;
+
+	// read-ahead of the upcoming pages
+	size_t last = std::min(paths.size(), position + 1 + readAhead);
+	for (advised = std::max(advised, position + 1); advised < last; advised++) {
+		adviseWillNeed(paths[advised]);
+	}
+
+	page.path = paths[position++];
+	page.image.release();
+	page.ioWaitMs = 0;
+	page.decodeMs = 0;
+	page.contentHash = 0;
+	page.fileSize = 0;
+	page.modificationTime = 0;
+
+	TRACE_SCOPE("loadPage");
+	int64 start = cv::getTickCount();
+	// before reading: a file rewritten meanwhile has a later time than the one journaled
+	struct stat st;
+	if (stat(page.path.c_str(), &st) == 0) {
+		page.fileSize = (uint64_t)st.st_size;
+		page.modificationTime = (int64_t)st.st_mtime;
+	}
+	MappedFile file;
+	if (!file.open(page.path) || file.size() == 0) return true;
+	file.willNeed();
+
+	// touching a byte per memory page waits for what the read-ahead didn't bring yet
+	const size_t memoryPage = 4096;
+	volatile unsigned char sink = 0;
+	{
+		TRACE_SCOPE("ioWait");
+		for (size_t offset = 0; offset < file.size(); offset += memoryPage) {
+			sink ^= file.data()[offset];
+		}
+	}
+	int64 loaded = cv::getTickCount();
+
+	if (hashContent) page.contentHash = fnv1a64(file.data(), file.size());
+
+	// no copy: the header points into the mapping
+	cv::Mat encoded(1, (int)file.size(), CV_8U, (void*)file.data());
+	{
+		TRACE_SCOPE("decode");
+		page.image = cv::imdecode(encoded, cv::IMREAD_COLOR);
+	}
+	int64 decoded = cv::getTickCount();
+
+	page.ioWaitMs = (loaded - start) * 1000. / cv::getTickFrequency();
+	page.decodeMs = (decoded - loaded) * 1000. / cv::getTickFrequency(); // with the hash, if any
+	return true;
+}
+
+std::vector<std::string> PageLoader::listInputs(const std::string& input) {
+	std::vector<std::string> pages;
+	size_t dot = input.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : input.substr(dot);
+
+	if (extension == ".png") {
+		pages.push_back(input);
+	}
+	else if (extension == ".txt") {
+		std::ifstream list(input);
+		std::string line;
+		while (std::getline(list, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (!line.empty()) pages.push_back(line);
+		}
+	}
+	else {
+		std::vector<cv::String> found;
+		cv::glob(input + "/*.png", found, false);
+		pages.assign(found.begin(), found.end());
+	}
+	return pages;
+}
+
+void PageLoader::adviseWillNeed(const std::string& path) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	// the read-ahead goes on once the descriptor is closed
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+#else
+	(void)path;
+#endif
+}
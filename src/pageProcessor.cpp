@@ -0,0 +1,58 @@
+#include "hashing.hpp"
+#include "pageProcessor.hpp"
+#include "trace.hpp"
+
+
+// icon zones of a given row are nearly identical from page to page:
+// the distance and verification rate of the cache come from the configuration
+PageProcessor::PageProcessor(const DetectionConfig& config, std::shared_ptr<const TemplateBank> templates, bool cacheSymbols)
+	: configuration(config), bank(templates), detect(findSquareDetector(config.engine)),
+	cacheSymbols(cacheSymbols), cache(config.symbolCacheDistance, config.symbolVerifyEvery) {
+}
+
+PageCells PageProcessor::process(const cv::Mat& image) const {
+	TRACE_SCOPE("process");
+	PageCells result;
+	result.layout = locateCells(image, configuration, detect, &result.rows);
+	classify(image, result);
+	return result;
+}
+
+PageCells PageProcessor::reclassify(const cv::Mat& image, const PageLayout& layout) const {
+	TRACE_SCOPE("reclassify");
+	PageCells result;
+	result.layout = layout;
+	classify(image, result);
+	return result;
+}
+
+void PageProcessor::classify(const cv::Mat& image, PageCells& result) const {
+	const TemplateBank* templates = bank.get();
+	SymbolCache::Classifier classifier = [templates](const cv::Mat& iconZone) {
+		return templates->whatSymbols(iconZone);
+	};
+
+	result.cells = classifyCells(image, result.layout, [&](int row, const cv::Mat& iconZone) {
+		return cacheSymbols ? cache.classify(row, iconZone, classifier) : classifier(iconZone);
+	}, &result.strip);
+
+	if (configuration.measuresInk() && !result.cells.empty()) {
+		// cells are cropped from the strip of a straightened page
+		const cv::Mat& source = result.strip.image.empty() ? image : result.strip.image;
+		cv::Point origin = result.strip.image.empty() ? cv::Point() : result.strip.origin;
+
+		// the integrals only cover the cells
+		cv::Rect zone = result.cells[0].rect;
+		for (const DetectedCell& cell : result.cells) zone |= cell.rect;
+		InkIntegral ink(source, cv::Rect(zone.x - origin.x, zone.y - origin.y, zone.width, zone.height));
+		for (DetectedCell& cell : result.cells) {
+			cv::Rect inSource(cell.rect.x - origin.x, cell.rect.y - origin.y, cell.rect.width, cell.rect.height);
+			cell.ink = ink.cellStats(inSource, configuration.inkMargin);
+		}
+	}
+}
+
+uint64_t PageProcessor::classificationHash() const {
+	uint64_t hashes[] = { configuration.classificationHash(), bank->hash() };
+	return fnv1a64(hashes, sizeof(hashes));
+}
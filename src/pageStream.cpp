@@ -0,0 +1,223 @@
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "opencv2/core/core.hpp"
+
+#include "pageStream.hpp"
+
+static bool isPng(const std::string& name) {
+	return name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0;
+}
+
+
+PageStream::PageStream() : state(std::make_shared<State>()), streaming(false) {
+}
+
+PageStream::~PageStream() {
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->stopping = true;
+	}
+	if (watcher.joinable()) watcher.join();
+}
+
+void PageStream::push(State& state, const std::string& page) {
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.queue.push_back(page);
+	}
+	state.arrived.notify_all();
+}
+
+bool PageStream::queueLocked(State& state, const std::string& page) {
+	auto failed = state.failures.find(page);
+	if (failed != state.failures.end() && failed->second >= maxAttempts) return false;
+	if (!state.pending.insert(page).second) return false;
+	state.queue.push_back(page);
+	return true;
+}
+
+void PageStream::pushNew(State& state, const std::string& page, bool written) {
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (written) {
+			// new content: a given up page gets its attempts back, a pending one is redone
+			state.failures.erase(page);
+			if (state.pending.count(page)) {
+				state.rewritten.insert(page);
+				return;
+			}
+		}
+		if (!queueLocked(state, page)) return;
+	}
+	state.arrived.notify_all();
+}
+
+void PageStream::pageDone(const std::string& page) {
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->pending.erase(page);
+		state->failures.erase(page);
+		if (state->rewritten.erase(page)) queued = queueLocked(*state, page);
+	}
+	if (queued) state->arrived.notify_all();
+}
+
+bool PageStream::pageFailed(const std::string& page) {
+	bool queued = false, givenUp;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->pending.erase(page);
+		if (state->rewritten.erase(page)) {
+			// written again since it was queued: the failure was likely a partial write
+			state->failures.erase(page);
+			queued = queueLocked(*state, page);
+		}
+		else state->failures[page]++;
+		// the next scan finds it again
+		state->scanned.erase(page);
+		givenUp = !queued && state->failures[page] >= maxAttempts;
+	}
+	if (queued) state->arrived.notify_all();
+	return givenUp;
+}
+
+void PageStream::finish(State& state) {
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.finished = true;
+	}
+	state.arrived.notify_all();
+}
+
+void PageStream::setPages(const std::vector<std::string>& pages) {
+	for (const std::string& page : pages) push(*state, page);
+	finish(*state);
+}
+
+void PageStream::readStdin() {
+	streaming = true;
+	std::shared_ptr<State> shared = state;
+	// detached: nothing can interrupt a read of stdin
+	std::thread([shared]() {
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (!line.empty()) push(*shared, line);
+		}
+		finish(*shared);
+	}).detach();
+}
+
+bool PageStream::watchDirectory(const std::string& directory) {
+	streaming = true;
+	watcher = std::thread(&PageStream::watchLoop, state, directory);
+	return true;
+}
+
+void PageStream::watchLoop(std::shared_ptr<State> state, std::string directory) {
+	auto stopping = [&]() {
+		std::lock_guard<std::mutex> lock(state->mutex);
+		return state->stopping;
+	};
+
+#ifdef __linux__
+	// watching before the first scan: a page can't fall between the two.
+	// A page still being written when scanned is queued by the scan, then
+	// once more by its close event.
+	int fd = inotify_init1(IN_NONBLOCK);
+	if (fd >= 0 && inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		close(fd);
+		fd = -1;
+	}
+#endif
+
+	// pages already in the spool, then the new ones; the paths are spelled
+	// as those of the events so that pushNew recognizes them. A page leaving
+	// the spool is forgotten: written there again, it is queued again.
+	auto scan = [&]() {
+		std::vector<cv::String> found;
+		cv::glob(directory + "/*.png", found, false);
+		std::set<std::string> present, added;
+		for (const cv::String& globbed : found) {
+			std::string path = globbed;
+			std::string name = path.substr(path.find_last_of("/\\") + 1);
+			present.insert(directory + "/" + name);
+		}
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			for (auto it = state->scanned.begin(); it != state->scanned.end(); ) {
+				if (present.count(*it)) ++it;
+				else {
+					state->failures.erase(*it);
+					it = state->scanned.erase(it);
+				}
+			}
+			for (const std::string& page : present) {
+				if (state->scanned.insert(page).second) added.insert(page);
+			}
+		}
+		for (const std::string& page : added) pushNew(*state, page, false);
+	};
+	scan();
+
+#ifdef __linux__
+	if (fd >= 0) {
+		std::vector<char> events(64 * 1024);
+		while (!stopping()) {
+			struct pollfd pfd = { fd, POLLIN, 0 };
+			if (poll(&pfd, 1, 200) <= 0) continue;
+
+			ssize_t length = read(fd, events.data(), events.size());
+			for (ssize_t offset = 0; offset < length; ) {
+				const struct inotify_event* event = (const struct inotify_event*)(events.data() + offset);
+				offset += sizeof(struct inotify_event) + event->len;
+				if (event->len == 0) continue;
+
+				// a page rewritten once done comes again, while pending once it is done
+				if (isPng(event->name)) pushNew(*state, directory + "/" + event->name, true);
+			}
+		}
+		close(fd);
+		return;
+	}
+	std::cerr << "PageStream: inotify unavailable, polling " << directory << std::endl;
+#endif
+
+	while (!stopping()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		scan();
+	}
+}
+
+bool PageStream::nextBatch(std::vector<std::string>& batch, int windowMs, size_t maxBatch) {
+	batch.clear();
+	std::unique_lock<std::mutex> lock(state->mutex);
+
+	state->arrived.wait(lock, [&]() { return !state->queue.empty() || state->finished; });
+	if (state->queue.empty()) return false;
+
+	// micro-batch: what arrives within the window is processed together
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(windowMs);
+	while (batch.size() < maxBatch) {
+		if (!state->queue.empty()) {
+			batch.push_back(state->queue.front());
+			state->queue.pop_front();
+			continue;
+		}
+		if (state->finished || !state->arrived.wait_until(lock, deadline,
+			[&]() { return !state->queue.empty() || state->finished; })) {
+			break;
+		}
+	}
+	return true;
+}
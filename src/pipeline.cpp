@@ -0,0 +1,653 @@
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "bitMask.hpp"
+#include "deskew.hpp"
+#include "histogram.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+// helper function:
+// finds a cosine of angle between vectors
+// from pt0->pt1 and from pt0->pt2
+static double angle(cv::Point pt1, cv::Point pt2, cv::Point pt0)
+{
+	double dx1 = pt1.x - pt0.x;
+	double dy1 = pt1.y - pt0.y;
+	double dx2 = pt2.x - pt0.x;
+	double dy2 = pt2.y - pt0.y;
+	return (dx1*dx2 + dy1*dy2) / sqrt((dx1*dx1 + dy1*dy1)*(dx2*dx2 + dy2*dy2) + 1e-10);
+}
+
+// runs the passes, ordered by channel, on the planes of image
+static void runPasses(const cv::Mat& image, const vector<DetectionPass>& passes, vector<square_t>& squares, const DetectionConfig& config)
+{
+	//s    cv::Mat pyr, timg, gray0(image.size(), CV_8U), gray;
+
+	// down-scale and upscale the image to filter out the noise
+	//pyrDown(image, pyr, Size(image.cols/2, image.rows/2));
+	//pyrUp(pyr, timg, image.size());
+
+
+	// blur will enhance edge detection
+	
+	cv::Mat timg(image);
+	//medianBlur(image, timg, 9);
+	cv::Mat gray0(timg.size(), CV_8U);
+
+	// find squares in every color plane of the image
+	for (int c = 0; c < 3; c++)
+	{
+		bool planeUsed = false;
+		for (const DetectionPass& pass : passes) planeUsed = planeUsed || pass.channel == c;
+		if (!planeUsed) continue;
+
+		TRACE_SCOPE("plane", "channel", c);
+		extractPlane(timg, c, gray0);
+
+		// the threshold levels of the plane, packed 1 bit per pixel in one read
+		vector<int> levels, thresholds;
+		for (const DetectionPass& pass : passes)
+		{
+			if (pass.channel != c || pass.level == 0) continue;
+			levels.push_back(pass.level);
+			thresholds.push_back(levelThreshold(pass.level, config.levels));
+		}
+		vector<BitMask> masks;
+		if (!levels.empty()) BitMask::fromThresholds(gray0, thresholds, masks);
+		vector<int64_t> counts;
+		for (const BitMask& mask : masks) counts.push_back(mask.count());
+		// squares[begin, end) found on the mask of each level
+		vector<size_t> begins(levels.size(), 0), ends(levels.size(), 0);
+		vector<bool> done(levels.size(), false);
+		size_t skipped = 0;
+
+		// try several threshold levels
+		for (const DetectionPass& pass : passes)
+		{
+			if (pass.channel != c) continue;
+			if (pass.level == 0)
+			{
+				findSquaresInPlane(gray0, 0, squares, config);
+				continue;
+			}
+			size_t i = std::find(levels.begin(), levels.end(), pass.level) - levels.begin();
+
+			// no contour on an empty mask; the same mask as a level already run gives
+			// the same squares (the masks of a plane are nested: same count, same mask)
+			bool empty = counts[i] == 0;
+			size_t same = levels.size();
+			for (size_t j = 0; j < levels.size() && !empty && same == levels.size(); j++)
+			{
+				if (done[j] && counts[j] == counts[i]) same = j;
+			}
+			begins[i] = squares.size();
+			if (empty || same < levels.size())
+			{
+				skipped++;
+				if (!empty)
+				{
+					squares.reserve(squares.size() + ends[same] - begins[same]);
+					for (size_t k = begins[same]; k < ends[same]; k++) squares.push_back(squares[k]);
+				}
+			}
+			else
+			{
+				TRACE_SCOPE("level", "level", pass.level);
+				findSquaresInMask(masks[i].toMat(), squares, config);
+			}
+			ends[i] = squares.size();
+			done[i] = true;
+		}
+		Tracer::counter("levels skipped", skipped);
+	}
+}
+
+vector<DetectionPass> selectPassesFromHistogram(const cv::Mat& image, const DetectionConfig& config)
+{
+	TRACE_SCOPE("selectPasses");
+	vector<DetectionPass> passes = config.activePasses();
+	ChannelHistograms hist = computeChannelHistograms(image);
+	const double step = 255.0 / config.levels;
+
+	vector<DetectionPass> selected;
+	for (int c = 0; c < 3; c++)
+	{
+		const vector<uint32_t>& counts = hist.counts[hist.channels() == 3 ? c : 0];
+		double separability;
+		double t = otsuThreshold(counts, &separability) * 256.0 / hist.bins;
+		// not bimodal: no level is better than the others
+		bool sweep = separability < config.minSeparability;
+
+		// the threshold level closest to t, and the one on the other side of t unless t is near it
+		int nearest = -1;
+		for (const DetectionPass& pass : passes)
+		{
+			if (pass.channel != c || pass.level == 0) continue;
+			if (nearest < 0 || fabs((pass.level + 1) * step - t) < fabs((nearest + 1) * step - t)) nearest = pass.level;
+		}
+		int other = -1;
+		if (nearest >= 0 && fabs((nearest + 1) * step - t) > step / 4)
+			other = (nearest + 1) * step > t ? nearest - 1 : nearest + 1;
+
+		for (const DetectionPass& pass : passes)
+		{
+			if (pass.channel != c) continue;
+			// Canny doesn't depend on the threshold
+			if (sweep || pass.level == 0 || pass.level == nearest || pass.level == other) selected.push_back(pass);
+		}
+	}
+	Tracer::counter("selected passes", selected.size());
+	return selected;
+}
+
+// returns sequence of squares detected on the image.
+// the sequence is stored in the specified memory storage
+void findSquares(const cv::Mat& image, vector<vector<cv::Point> >& squares, const DetectionConfig& config)
+{
+	TRACE_SCOPE("findSquares");
+	squares.clear();
+
+	// passes of the configuration, ordered by channel
+	vector<DetectionPass> passes = config.activePasses();
+	if (!config.adaptiveLevels)
+	{
+		runPasses(image, passes, squares, config);
+		return;
+	}
+
+	vector<DetectionPass> selected = selectPassesFromHistogram(image, config);
+	runPasses(image, selected, squares, config);
+	if (squares.size() >= (size_t)config.minAdaptiveQuads || selected.size() == passes.size()) return;
+
+	// too few quads: the passes left out run too
+	vector<DetectionPass> remaining;
+	for (const DetectionPass& pass : passes)
+	{
+		bool done = false;
+		for (const DetectionPass& s : selected) done = done || (s.channel == pass.channel && s.level == pass.level);
+		if (!done) remaining.push_back(pass);
+	}
+	Tracer::counter("full sweep fallback", 1);
+	runPasses(image, remaining, squares, config);
+}
+
+void extractPlane(const cv::Mat& image, int c, cv::Mat& plane)
+{
+	plane.create(image.size(), CV_8U);
+	int ch[] = { c, 0 };
+	mixChannels(&image, 1, &plane, 1, ch, 1);
+}
+
+void findSquaresInPlane(const cv::Mat& gray0, int l, vector<square_t>& squares, const DetectionConfig& config)
+{
+	TRACE_SCOPE("level", "level", l);
+	cv::Mat gray;
+
+	// hack: use Canny instead of zero threshold level.
+	// Canny helps to catch squares with gradient shading
+	if (l == 0)
+	{
+		// apply Canny. Take the upper threshold from slider
+		// and set the lower to 0 (which forces edges merging)
+		Canny(gray0, gray, 5, config.thresh, 5);
+		// dilate canny output to remove potential
+		// holes between edge segments
+		dilate(gray, gray, cv::Mat(), cv::Point(-1, -1));
+	}
+	else
+	{
+		// apply threshold if l!=0:
+		//     tgray(x,y) = gray(x,y) < (l+1)*255/N ? 255 : 0
+		gray = gray0 >= levelThreshold(l, config.levels);
+	}
+	findSquaresInMask(gray, squares, config);
+}
+
+int levelThreshold(int level, int levels)
+{
+	return (level + 1) * 255 / levels;
+}
+
+void findSquaresInMask(const cv::Mat& gray, vector<square_t>& squares, const DetectionConfig& config)
+{
+	vector<vector<cv::Point> > contours;
+	size_t candidates = 0, found = squares.size();
+
+	// find contours and store them all as a list
+	findContours(gray, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+
+	vector<cv::Point> approx;
+
+	// test each contour
+	for (size_t i = 0; i < contours.size(); i++)
+	{
+		// approximate contour with accuracy proportional
+		// to the contour perimeter
+		approxPolyDP(cv::Mat(contours[i]), approx, arcLength(cv::Mat(contours[i]), true)*0.02, true);
+
+		// square contours should have 4 vertices after approximation
+		// relatively large area (to filter out noisy contours)
+		// and be convex.
+		// Note: absolute value of an area is used because
+		// area may be positive or negative - in accordance with the
+		// contour orientation
+		if (approx.size() == 4 &&
+			fabs(contourArea(cv::Mat(approx))) > config.minContourArea &&
+			isContourConvex(cv::Mat(approx)))
+		{
+			candidates++;
+
+			// if cosines of all angles are small
+			// (all angles are ~90 degree) then write quandrange
+			// vertices to resultant sequence
+			if (maxQuadCosine(approx) < 0.3)
+				squares.push_back(approx);
+		}
+	}
+
+	Tracer::counter("contours", contours.size());
+	Tracer::counter("approx candidates", candidates);
+	Tracer::counter("squares found", squares.size() - found);
+}
+
+double maxQuadCosine(const square_t& quad)
+{
+	double maxCosine = 0;
+	for (int j = 2; j < 5; j++)
+	{
+		// find the maximum cosine of the angle between joint edges
+		double cosine = fabs(angle(quad[j % 4], quad[j - 2], quad[j - 1]));
+		maxCosine = MAX(maxCosine, cosine);
+	}
+	return maxCosine;
+}
+
+// returns true if cv::PointA < cv::PointB
+// orders points by row first, then column
+static bool compare_points(cv::Point& pointA, cv::Point& pointB, float proximity_tolerance) {
+	if (pointA.y < pointB.y - proximity_tolerance) return true;
+	if (pointA.y > pointB.y + proximity_tolerance) return false;
+	if (pointA.x < pointB.x - proximity_tolerance) return true;
+	return false;
+}
+
+// returns true if the upper left corner of a is < ulc of b
+static bool compare_square_t(square_t& a, square_t& b) {
+	cv::Point pointA = a[0], pointB = b[0];
+	return compare_points(pointA, pointB, 50);
+}
+
+static int upperLeft(square_t& sq) {
+	int idx = 0;
+	cv::Point min = sq[0];
+	for (int i = 1; i < sq.size(); i++) {
+		if (sq[i].x <= min.x && abs(sq[i].y - min.y) < 20 ) {
+			min = sq[i];
+			idx = i;
+		}
+	}
+	return idx;
+}
+
+
+void filterBySize(vector<square_t>& in, vector<square_t>& out, double minWidth, double maxWidth) {
+	TRACE_SCOPE("filterBySize");
+	for (int i = 0; i < in.size(); i++)
+	{
+		//def des points
+		cv::Point p1 = in[i][0];
+		cv::Point p2 = in[i][1];
+		cv::Point p3 = in[i][2];
+		cv::Point p4 = in[i][3];
+
+		//calcul de taille du carr
+		int distancex = (p2.x - p1.x) ^ 2;
+		int distancey = (p2.y - p1.y) ^ 2;
+
+		double width = sqrt(abs(distancex - distancey));
+
+		if (width > minWidth && width < maxWidth) {
+			vector<cv::Point> points;
+			points.push_back(p1);
+			points.push_back(p2);
+			points.push_back(p3);
+			points.push_back(p4);
+			out.push_back(points);
+		}
+	}
+	Tracer::counter("squares kept by size", out.size());
+}
+
+void rotateSquares(vector<square_t>& squaresBis) {
+	TRACE_SCOPE("rotateSquares");
+	for (square_t& sq : squaresBis) {
+		int mouv = upperLeft(sq);
+		vector<cv::Point> inter = sq;
+		sq[(0 + mouv) % 4] = inter[0];
+		sq[(1 + mouv) % 4] = inter[1];
+		sq[(2 + mouv) % 4] = inter[2];
+		sq[(3 + mouv) % 4] = inter[3];
+	}
+}
+
+
+bool squaresOverlap(square_t& a, square_t& b, float tolX, float tolY) {
+	cv::Point pointA = a[0], pointB = b[0];
+	return abs(pointB.x - pointA.x) < tolX && abs(pointB.y - pointA.y) < tolY;
+}
+
+void filterOverlappingSquares(vector<square_t>& in, vector<square_t>& out, float tolX, float tolY) {
+	TRACE_SCOPE("filterOverlappingSquares");
+	std::sort(in.begin(), in.end(), compare_square_t);
+
+	for (auto sq : in) {
+		if (out.size() == 0
+			|| !squaresOverlap(out[out.size() - 1], sq, tolX, tolY)) {
+			out.push_back(sq);
+		}
+	}
+	Tracer::counter("squares kept", out.size());
+}
+
+
+bool areSameRow(square_t a, square_t b, float tolY) {
+	return std::abs(a[0].y - b[0].y) < tolY;
+}
+
+vector<vector<square_t>> groupByRow(vector<square_t>& squares, float tolY) {
+	TRACE_SCOPE("groupByRow");
+	//Trier les carrs par lignes
+	vector<vector<square_t>> lignes;
+
+	std::sort(squares.begin(), squares.end(), compare_square_t);
+
+	vector<square_t> currentRow;
+
+	currentRow.push_back(squares[0]);
+	for (int i = 1; i < squares.size(); i++) {
+		if (!areSameRow(squares[i], squares[i - 1], tolY)) {
+			lignes.push_back(currentRow);
+			currentRow = vector<square_t>();
+		}
+		currentRow.push_back(squares[i]);
+	}
+	lignes.push_back(currentRow);
+	return lignes;
+}
+
+
+CellScale estimateCellScale(const vector<square_t>& squares, double referenceSide, int minSamples) {
+	TRACE_SCOPE("estimateCellScale");
+	CellScale result;
+	if (squares.empty() || referenceSide <= 0) return result;
+
+	// side of a quad: mean length of its 4 edges
+	vector<double> sides;
+	sides.reserve(squares.size());
+	for (const square_t& sq : squares) {
+		if (sq.size() != 4) continue;
+		double perimeter = 0;
+		for (int j = 0; j < 4; j++) perimeter += cv::norm(sq[(j + 1) % 4] - sq[j]);
+		sides.push_back(perimeter / 4);
+	}
+
+	// log scale histogram: bins of the same relative width whatever the resolution
+	const double minSide = 8, binWidth = 0.02;
+	const int binCount = 400; // up to 8 * e^8 pixels
+	vector<int> bins(binCount, 0);
+	for (double side : sides) {
+		if (side < minSide) continue;
+		int b = (int)(log(side / minSide) / binWidth);
+		if (b < binCount) bins[b]++;
+	}
+
+	// mode over 3 neighbouring bins, a cell size falls across bin edges
+	int best = -1, bestCount = 0;
+	for (int b = 0; b < binCount; b++) {
+		int count = bins[b] + (b > 0 ? bins[b - 1] : 0) + (b + 1 < binCount ? bins[b + 1] : 0);
+		if (count > bestCount) {
+			bestCount = count;
+			best = b;
+		}
+	}
+	if (best < 0 || bestCount < minSamples) return result;
+
+	// median of the sides around the mode
+	double center = minSide * exp((best + 0.5) * binWidth);
+	vector<double> near;
+	for (double side : sides) {
+		if (fabs(side - center) <= center * 2 * binWidth) near.push_back(side);
+	}
+	if (near.empty()) return result;
+	std::nth_element(near.begin(), near.begin() + near.size() / 2, near.end());
+
+	result.found = true;
+	result.samples = (int)near.size();
+	result.side = near[near.size() / 2];
+	result.scale = result.side / referenceSide;
+	Tracer::counter("cell side", (int64_t)result.side);
+	return result;
+}
+
+// applies the affine transform (2x3, CV_64F) to the corners of the squares
+static void transformSquares(vector<square_t>& squares, const cv::Mat& transform) {
+	const double* m = transform.ptr<double>(0);
+	for (square_t& sq : squares) {
+		for (cv::Point& p : sq) {
+			double x = p.x, y = p.y;
+			p.x = cvRound(m[0] * x + m[1] * y + m[2]);
+			p.y = cvRound(m[3] * x + m[4] * y + m[5]);
+		}
+	}
+}
+
+cv::Mat cropCell(const cv::Mat& page, const PageStrip& strip, const cv::Rect& rect) {
+	if (strip.image.empty()) return cv::Mat(page, rect & cv::Rect(0, 0, page.cols, page.rows));
+	cv::Rect inStrip(rect.x - strip.origin.x, rect.y - strip.origin.y, rect.width, rect.height);
+	return cv::Mat(strip.image, inStrip & cv::Rect(0, 0, strip.image.cols, strip.image.rows));
+}
+
+static void scaleSquares(vector<square_t>& squares, double factor) {
+	for (square_t& sq : squares) {
+		for (cv::Point& p : sq) {
+			p.x = cvRound(p.x * factor);
+			p.y = cvRound(p.y * factor);
+		}
+	}
+}
+
+
+static const struct {
+	const char* name;
+	void (*detect)(const cv::Mat&, vector<square_t>&, const DetectionConfig&);
+	bool ordered; // one square per cell, by row then column
+} squareDetectors[] = {
+	{ "contours", findSquares, false },
+	{ "tree", findGridCellsTree, true },
+	{ "components", findGridCellsComponents, true },
+	{ "runs", findGridCellsRuns, true },
+	{ "lines", findGridCellsLines, true },
+};
+
+SquareDetector findSquareDetector(const string& engine) {
+	for (const auto& detector : squareDetectors) {
+		if (engine == detector.name) return detector.detect;
+	}
+	return SquareDetector();
+}
+
+bool squareDetectorOrdersCells(const string& engine) {
+	for (const auto& detector : squareDetectors) {
+		if (engine == detector.name) return detector.ordered;
+	}
+	return false;
+}
+
+// rows of squares in row then column order: a row ends where x goes back
+static vector<vector<square_t>> splitOrderedRows(const vector<square_t>& squares) {
+	vector<vector<square_t>> rows;
+	for (size_t i = 0; i < squares.size(); i++) {
+		if (i == 0 || squares[i][0].x <= squares[i - 1][0].x) rows.push_back(vector<square_t>());
+		rows.back().push_back(squares[i]);
+	}
+	return rows;
+}
+
+vector<string> squareDetectorNames() {
+	vector<string> names;
+	for (const auto& detector : squareDetectors) names.push_back(detector.name);
+	return names;
+}
+
+string PageLayout::toString() const {
+	std::ostringstream text;
+	text.precision(17); // the angle is read back as it was
+	text << angle << ' ' << iconZones.size();
+	for (size_t k = 0; k < iconZones.size(); k++) {
+		const cv::Rect& zone = iconZones[k];
+		text << ' ' << zone.x << ' ' << zone.y << ' ' << zone.width << ' ' << zone.height << ' ' << cells[k].size();
+		for (const cv::Rect& cell : cells[k]) text << ' ' << cell.x << ' ' << cell.y << ' ' << cell.width << ' ' << cell.height;
+	}
+	return text.str();
+}
+
+bool PageLayout::fromString(const string& text, PageLayout& layout) {
+	std::istringstream fields(text);
+	layout = PageLayout();
+	size_t numRows = 0;
+	if (!(fields >> layout.angle >> numRows)) return false;
+	for (size_t k = 0; k < numRows; k++) {
+		cv::Rect zone;
+		size_t numCells = 0;
+		if (!(fields >> zone.x >> zone.y >> zone.width >> zone.height >> numCells)) return false;
+		vector<cv::Rect> row;
+		for (size_t u = 0; u < numCells; u++) {
+			cv::Rect cell;
+			if (!(fields >> cell.x >> cell.y >> cell.width >> cell.height)) return false;
+			row.push_back(cell);
+		}
+		layout.iconZones.push_back(zone);
+		layout.cells.push_back(row);
+	}
+	return true;
+}
+
+vector<DetectedCell> detectCells(const cv::Mat& image, const DetectionConfig& config, const SquareDetector& detect,
+	const RowClassifier& classify, vector<vector<square_t>>* rows, PageStrip* strip) {
+	return classifyCells(image, locateCells(image, config, detect, rows), classify, strip);
+}
+
+PageLayout locateCells(const cv::Mat& image, const DetectionConfig& config, const SquareDetector& detect,
+	vector<vector<square_t>>* rows) {
+	vector<square_t> squares;
+	double detectionScale = config.detectionScale;
+	if (detectionScale > 0 && detectionScale < 1) {
+		// detect on a reduced copy, the squares are brought back to the page
+		cv::Mat proxy;
+		{
+			TRACE_SCOPE("detectionProxy");
+			cv::resize(image, proxy, cv::Size(), detectionScale, detectionScale, cv::INTER_AREA);
+		}
+		detect(proxy, squares, config.scaled(detectionScale));
+		scaleSquares(squares, 1 / detectionScale);
+	}
+	else detect(image, squares, config);
+
+	// skewed page: the squares go to the frame of the straightened page
+	PageLayout layout;
+	if (config.deskew) {
+		double angle = estimateSkew(image, config.maxSkew);
+		if (fabs(angle) > config.skewThreshold) {
+			layout.angle = angle;
+			transformSquares(squares, straighteningTransform(image.size(), angle));
+		}
+	}
+
+	// pixel sizes of the filters for the cell size of this page
+	DetectionConfig pageConfig = config;
+	if (config.estimateScale) {
+		CellScale cellScale = estimateCellScale(squares, config.referenceCellSide);
+		// small differences are kept at the reference so that its output doesn't move
+		if (cellScale.found && fabs(cellScale.scale - 1) > 0.02) pageConfig = config.scaled(cellScale.scale);
+	}
+
+	// engines giving the cells in order need neither the filters nor groupByRow
+	bool ordered = squareDetectorOrdersCells(config.engine);
+	vector<square_t> filtered;
+	if (ordered) {
+		filtered.swap(squares);
+		rotateSquares(filtered);
+	}
+	else {
+		vector<square_t> squaresBis;
+		filterBySize(squares, squaresBis, pageConfig.minSquareWidth, pageConfig.maxSquareWidth);
+		rotateSquares(squaresBis);
+		filterOverlappingSquares(squaresBis, filtered, pageConfig.overlapTolX, pageConfig.overlapTolY);
+	}
+
+	if (rows) rows->clear();
+	if (filtered.empty()) return layout;
+
+	cv::Rect page(0, 0, image.cols, image.rows);
+	vector<vector<square_t>> lignes = ordered ? splitOrderedRows(filtered) : groupByRow(filtered, pageConfig.rowTolerance);
+	for (const vector<square_t>& ligne : lignes) {
+		layout.iconZones.push_back(cv::Rect(0, ligne[0][0].y, pageConfig.iconZoneWidth, pageConfig.iconZoneHeight) & page);
+		vector<cv::Rect> row;
+		for (const square_t& sq : ligne) row.push_back(cv::Rect(sq[0], sq[2]));
+		layout.cells.push_back(row);
+	}
+	if (rows) rows->swap(lignes);
+	return layout;
+}
+
+vector<DetectedCell> classifyCells(const cv::Mat& image, const PageLayout& layout, const RowClassifier& classify,
+	PageStrip* strip) {
+	vector<DetectedCell> cells;
+	if (strip) *strip = PageStrip();
+	if (layout.iconZones.empty()) return cells;
+
+	PageStrip straight;
+	if (layout.angle != 0) {
+		// one warp of the band of the page holding the rows, not of the whole page
+		cv::Rect page(0, 0, image.cols, image.rows);
+		cv::Rect band = layout.iconZones[0];
+		for (size_t k = 0; k < layout.iconZones.size(); k++) {
+			band |= layout.iconZones[k];
+			for (const cv::Rect& rect : layout.cells[k]) band |= rect;
+		}
+		band &= page;
+
+		TRACE_SCOPE("straighten", "rows", band.height);
+		straight.angle = layout.angle;
+		cv::Mat shifted = straighteningTransform(image.size(), layout.angle);
+		shifted.at<double>(0, 2) -= band.x;
+		shifted.at<double>(1, 2) -= band.y;
+		cv::warpAffine(image, straight.image, shifted, band.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+		straight.origin = band.tl();
+	}
+
+	for (int k = 0; k < layout.iconZones.size(); k++) {
+		TRACE_SCOPE("row", "row", k + 1);
+		//Select interest zone 
+		cv::Mat subImage = cropCell(image, straight, layout.iconZones[k]);
+		SymbolLabel templateAndSize = classify(k, subImage);
+
+		for (int u = 0; u < layout.cells[k].size(); u++) {
+			DetectedCell cell;
+			cell.row = k + 1;
+			cell.column = u + 1;
+			cell.rect = layout.cells[k][u];
+			cell.label = templateAndSize;
+			cells.push_back(cell);
+		}
+	}
+	if (strip) *strip = straight;
+	return cells;
+}
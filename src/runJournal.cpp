@@ -0,0 +1,134 @@
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "hashing.hpp"
+#include "mappedFile.hpp"
+#include "runJournal.hpp"
+#include "trace.hpp"
+
+
+RunJournal::RunJournal() : file(NULL) {
+}
+
+// pages not committed are dropped: their outputs may be incomplete
+RunJournal::~RunJournal() {
+	if (file != NULL) std::fclose(file);
+}
+
+bool RunJournal::open(const std::string& path) {
+	entries.clear();
+	pending.clear();
+
+	// page \t size \t time \t content hash \t detection hash \t classification hash \t output1|output2... \t layout
+	// Lines of the former format, with a single configuration hash before the outputs,
+	// are kept for their outputs: their pages are redone.
+	std::ifstream existing(path);
+	std::string line;
+	bool truncated = false;
+	while (std::getline(existing, line)) {
+		// last line without its end: cut by a crash
+		truncated = existing.eof();
+		if (truncated) break;
+		std::vector<std::string> fields;
+		std::istringstream split(line);
+		std::string field;
+		while (std::getline(split, field, '\t')) fields.push_back(field);
+		bool former = fields.size() == 6;
+		if (!former && fields.size() != 8) continue;
+
+		Entry entry;
+		std::istringstream status(fields[1] + ' ' + fields[2] + ' ' + fields[3]);
+		status >> entry.fileSize >> entry.modificationTime >> std::hex >> entry.contentHash;
+		if (status.fail()) continue;
+		if (!former) {
+			std::istringstream hashes(fields[4] + ' ' + fields[5]);
+			hashes >> std::hex >> entry.detectionHash >> entry.classificationHash;
+			if (hashes.fail()) continue;
+			entry.layout = fields[7];
+		}
+		std::istringstream outputs(fields[former ? 5 : 6]);
+		while (std::getline(outputs, field, '|')) {
+			if (!field.empty()) entry.outputs.push_back(field);
+		}
+		entries[fields[0]] = entry;
+	}
+	existing.close();
+
+	if (file != NULL) std::fclose(file);
+	file = std::fopen(path.c_str(), "ab");
+	// the next line starts after the cut one
+	if (file != NULL && truncated) std::fputc('\n', file);
+	return file != NULL;
+}
+
+RunJournal::Status RunJournal::status(const std::string& page, uint64_t detectionHash, uint64_t classificationHash) const {
+	auto it = entries.find(page);
+	if (it == entries.end() || it->second.detectionHash != detectionHash || it->second.layout.empty()) return TODO;
+
+	uint64_t size;
+	int64_t modificationTime;
+	if (!fileStatus(page, size, modificationTime) || size != it->second.fileSize) return TODO;
+	// touched or copied: same content?
+	if (modificationTime != it->second.modificationTime && hashFile(page) != it->second.contentHash) return TODO;
+
+	return it->second.classificationHash == classificationHash ? DONE : RECLASSIFY;
+}
+
+const RunJournal::Entry* RunJournal::find(const std::string& page) const {
+	auto it = entries.find(page);
+	return it == entries.end() ? NULL : &it->second;
+}
+
+void RunJournal::markDone(const std::string& page, const Entry& entry) {
+	pending.push_back(std::make_pair(page, entry));
+}
+
+bool RunJournal::commit() {
+	TRACE_SCOPE("journalCommit");
+	if (file == NULL || pending.empty()) return file != NULL;
+
+	std::ostringstream lines;
+	for (auto& done : pending) {
+		const Entry& entry = done.second;
+		lines << done.first << '\t' << entry.fileSize << '\t' << entry.modificationTime << '\t'
+			<< std::hex << entry.contentHash << '\t' << entry.detectionHash << '\t' << entry.classificationHash << std::dec << '\t';
+		for (size_t i = 0; i < entry.outputs.size(); i++) {
+			if (i > 0) lines << '|';
+			lines << entry.outputs[i];
+		}
+		lines << '\t' << entry.layout << '\n';
+		entries[done.first] = entry;
+	}
+	pending.clear();
+
+	std::string data = lines.str();
+	bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+	ok = std::fflush(file) == 0 && ok;
+#ifdef _WIN32
+	ok = _commit(_fileno(file)) == 0 && ok;
+#else
+	ok = fsync(fileno(file)) == 0 && ok;
+#endif
+	return ok;
+}
+
+uint64_t RunJournal::hashFile(const std::string& path) {
+	MappedFile mapped;
+	if (!mapped.open(path)) return 0;
+	return fnv1a64(mapped.data(), mapped.size());
+}
+
+bool RunJournal::fileStatus(const std::string& path, uint64_t& size, int64_t& modificationTime) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+	size = (uint64_t)st.st_size;
+	modificationTime = (int64_t)st.st_mtime;
+	return true;
+}
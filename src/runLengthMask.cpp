@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <numeric>
+
+#include "runLengthMask.hpp"
+#include "trace.hpp"
+
+using std::vector;
+
+
+// runs of the pixels of each row for which isForeground(value) holds
+template <class Predicate>
+static void encodeRows(const cv::Mat& plane, Predicate isForeground, vector<RunLengthMask::Run>& runs, vector<uint32_t>& rowOffsets) {
+	CV_Assert(plane.type() == CV_8U);
+	rowOffsets.assign(1, 0);
+	rowOffsets.reserve(plane.rows + 1);
+	for (int y = 0; y < plane.rows; y++) {
+		const uchar* p = plane.ptr<uchar>(y);
+		int x = 0;
+		while (x < plane.cols) {
+			while (x < plane.cols && !isForeground(p[x])) x++;
+			if (x == plane.cols) break;
+			int start = x;
+			while (x < plane.cols && isForeground(p[x])) x++;
+			runs.push_back({ start, x });
+		}
+		rowOffsets.push_back((uint32_t)runs.size());
+	}
+}
+
+RunLengthMask RunLengthMask::fromThreshold(const cv::Mat& plane, int threshold, bool below) {
+	TRACE_SCOPE("runLengthThreshold");
+	RunLengthMask mask;
+	mask.width = plane.cols;
+	mask.height = plane.rows;
+	if (below) encodeRows(plane, [threshold](uchar v) { return v < threshold; }, mask.runs, mask.rowOffsets);
+	else encodeRows(plane, [threshold](uchar v) { return v >= threshold; }, mask.runs, mask.rowOffsets);
+	Tracer::counter("runs", mask.runs.size());
+	return mask;
+}
+
+RunLengthMask RunLengthMask::fromMask(const cv::Mat& binary) {
+	return fromThreshold(binary, 1);
+}
+
+RunLengthMask RunLengthMask::inverted() const {
+	RunLengthMask mask;
+	mask.width = width;
+	mask.height = height;
+	mask.rowOffsets.assign(1, 0);
+	for (int y = 0; y < height; y++) {
+		int x = 0;
+		for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) {
+			if (run->start > x) mask.runs.push_back({ x, run->start });
+			x = run->end;
+		}
+		if (x < width) mask.runs.push_back({ x, width });
+		mask.rowOffsets.push_back((uint32_t)mask.runs.size());
+	}
+	return mask;
+}
+
+vector<int> RunLengthMask::rowProjection() const {
+	vector<int> projection(height, 0);
+	for (int y = 0; y < height; y++) {
+		for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) projection[y] += run->end - run->start;
+	}
+	return projection;
+}
+
+vector<int> RunLengthMask::columnProjection() const {
+	// +1 where a run starts, -1 where it ends, then the prefix sums
+	vector<int> delta(width + 1, 0);
+	for (const Run& run : runs) {
+		delta[run.start]++;
+		delta[run.end]--;
+	}
+	vector<int> projection(width);
+	std::partial_sum(delta.begin(), delta.end() - 1, projection.begin());
+	return projection;
+}
+
+int64_t RunLengthMask::count(const cv::Rect& area) const {
+	cv::Rect roi = area & cv::Rect(0, 0, width, height);
+	int64_t total = 0;
+	for (int y = roi.y; y < roi.y + roi.height; y++) {
+		for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) {
+			int start = std::max(run->start, roi.x), end = std::min(run->end, roi.x + roi.width);
+			if (end > start) total += end - start;
+		}
+	}
+	return total;
+}
+
+cv::Rect RunLengthMask::boundingBox(const cv::Rect& area) const {
+	cv::Rect roi = area & cv::Rect(0, 0, width, height);
+	int left = INT32_MAX, right = -1, top = -1, bottom = -1;
+	for (int y = roi.y; y < roi.y + roi.height; y++) {
+		for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) {
+			int start = std::max(run->start, roi.x), end = std::min(run->end, roi.x + roi.width);
+			if (end <= start) continue;
+			left = std::min(left, start);
+			right = std::max(right, end);
+			if (top < 0) top = y;
+			bottom = y;
+		}
+	}
+	return top < 0 ? cv::Rect() : cv::Rect(left, top, right - left, bottom - top + 1);
+}
+
+static int findRoot(vector<int>& parent, int i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+vector<RunLengthMask::Component> RunLengthMask::components(bool eightConnected) const {
+	TRACE_SCOPE("runComponents");
+	vector<int> parent(runs.size());
+	std::iota(parent.begin(), parent.end(), 0);
+
+	// runs of consecutive rows touching each other: one pass with two cursors
+	const int reach = eightConnected ? 1 : 0;
+	for (int y = 1; y < height; y++) {
+		uint32_t above = rowOffsets[y - 1];
+		for (uint32_t i = rowOffsets[y]; i < rowOffsets[y + 1]; i++) {
+			while (above < rowOffsets[y] && runs[above].end + reach <= runs[i].start) above++;
+			for (uint32_t j = above; j < rowOffsets[y] && runs[j].start < runs[i].end + reach; j++) {
+				int a = findRoot(parent, i), b = findRoot(parent, j);
+				if (a != b) parent[std::max(a, b)] = std::min(a, b);
+			}
+		}
+	}
+
+	// stats of each root
+	vector<int> index(runs.size(), -1);
+	vector<Component> found;
+	vector<cv::Point> corners; // bottom right of each component
+	for (int y = 0; y < height; y++) {
+		for (uint32_t i = rowOffsets[y]; i < rowOffsets[y + 1]; i++) {
+			int root = findRoot(parent, i);
+			if (index[root] < 0) {
+				index[root] = (int)found.size();
+				found.push_back({ cv::Rect(runs[i].start, y, 0, 0), 0 });
+				corners.push_back(cv::Point(runs[i].end, y + 1));
+			}
+			Component& c = found[index[root]];
+			cv::Point& corner = corners[index[root]];
+			c.box.x = std::min(c.box.x, runs[i].start);
+			corner.x = std::max(corner.x, runs[i].end);
+			corner.y = y + 1;
+			c.area += runs[i].end - runs[i].start;
+		}
+	}
+	for (size_t k = 0; k < found.size(); k++) {
+		found[k].box.width = corners[k].x - found[k].box.x;
+		found[k].box.height = corners[k].y - found[k].box.y;
+	}
+	return found;
+}
+
+cv::Mat RunLengthMask::toMat(const cv::Rect& area) const {
+	cv::Rect roi = area & cv::Rect(0, 0, width, height);
+	cv::Mat mat(roi.height, roi.width, CV_8U, cv::Scalar(0));
+	for (int y = roi.y; y < roi.y + roi.height; y++) {
+		uchar* p = mat.ptr<uchar>(y - roi.y);
+		for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) {
+			int start = std::max(run->start, roi.x), end = std::min(run->end, roi.x + roi.width);
+			if (end > start) std::fill(p + start - roi.x, p + end - roi.x, (uchar)255);
+		}
+	}
+	return mat;
+}
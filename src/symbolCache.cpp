@@ -0,0 +1,113 @@
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "symbolCache.hpp"
+
+
+SymbolCache::SymbolCache(int maxDistance, int verifyEvery, size_t maxEntriesPerRow)
+	: maxDistance(maxDistance), verifyEvery(verifyEvery), maxEntriesPerRow(maxEntriesPerRow) {
+}
+
+SymbolLabel SymbolCache::classify(int row, const cv::Mat& zone, const Classifier& classifier) {
+	uint64_t hash = dHash(zone);
+	bool verify = false;
+	SymbolLabel cached;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		counters.lookups++;
+
+		// nearest classified zone of the same row
+		int bestDistance = maxDistance + 1;
+		auto it = rows.find(row);
+		if (it != rows.end()) {
+			for (const Entry& entry : it->second) {
+				int distance = hammingDistance(entry.hash, hash);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					cached = entry.label;
+				}
+			}
+		}
+
+		if (bestDistance <= maxDistance) {
+			counters.hits++;
+			verify = verifyEvery > 0 && counters.hits % verifyEvery == 0;
+			if (!verify) return cached;
+			counters.verifications++;
+		}
+	}
+
+	// miss or verification sample: run the real classifier without holding the lock
+	SymbolLabel label = classifier(zone);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (verify && (label.name != cached.name || label.size != cached.size)) {
+		counters.mismatches++;
+	}
+	store(row, hash, label);
+	return label;
+}
+
+void SymbolCache::store(int row, uint64_t hash, const SymbolLabel& label) {
+	std::vector<Entry>& entries = rows[row];
+
+	// a near duplicate is replaced so that a wrong entry is corrected by its verification
+	for (Entry& entry : entries) {
+		if (hammingDistance(entry.hash, hash) <= maxDistance) {
+			entry.hash = hash;
+			entry.label = label;
+			return;
+		}
+	}
+
+	if (entries.size() >= maxEntriesPerRow) {
+		entries.erase(entries.begin());
+	}
+	Entry entry = { hash, label };
+	entries.push_back(entry);
+}
+
+SymbolCache::Stats SymbolCache::stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return counters;
+}
+
+void SymbolCache::printStats(std::ostream& out) const {
+	Stats s = stats();
+	out << "symbol cache: " << s.lookups << " lookups, "
+		<< s.hits << " hits (" << (int)(s.hitRate() * 100 + 0.5) << "%), "
+		<< s.verifications << " verifications, "
+		<< s.mismatches << " mismatches" << std::endl;
+}
+
+void SymbolCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	rows.clear();
+	counters = Stats();
+}
+
+uint64_t SymbolCache::dHash(const cv::Mat& image) {
+	cv::Mat gray, small;
+	if (image.channels() == 3) cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+	else gray = image;
+
+	cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+
+	uint64_t hash = 0;
+	for (int y = 0; y < 8; y++) {
+		const uchar* line = small.ptr<uchar>(y);
+		for (int x = 0; x < 8; x++) {
+			hash = (hash << 1) | (line[x] < line[x + 1] ? 1 : 0);
+		}
+	}
+	return hash;
+}
+
+int SymbolCache::hammingDistance(uint64_t a, uint64_t b) {
+	uint64_t v = a ^ b;
+	// SWAR popcount
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((v * 0x0101010101010101ULL) >> 56);
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "hashing.hpp"
+#include "templateBank.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+static const char* symbolNames[] = {
+	"accident", "bomb", "car", "casualty", "electricity", "fire", "fireBrigade",
+	"flood", "gas", "injury", "paramedics", "person", "police", "roadBlock"
+};
+static const char* sizeNames[] = { "small", "medium", "large" };
+
+//charge la base de template
+bool TemplateBank::load(const string& directory) {
+	string prefix = directory;
+	if (!prefix.empty() && prefix.back() != '/' && prefix.back() != '\\') prefix += "/";
+
+	symbolTemplates.clear();
+	sizeTemplates.clear();
+	bool ok = true;
+	for (const char* name : symbolNames) {
+		symbolTemplates.push_back(cv::imread(prefix + name + ".png"));
+		if (symbolTemplates.back().empty()) ok = false;
+	}
+	for (const char* name : sizeNames) {
+		sizeTemplates.push_back(cv::imread(prefix + name + ".png"));
+		if (sizeTemplates.back().empty()) ok = false;
+	}
+	if (!ok) cerr << "Couldn't load the templates of " << directory << endl;
+	return ok;
+}
+
+uint64_t TemplateBank::hash() const {
+	uint64_t h = fnv1a64(NULL, 0);
+	for (const cv::Mat& symbol : symbolTemplates) h = hashImage(symbol, h);
+	for (const cv::Mat& size : sizeTemplates) h = hashImage(size, h);
+	return h;
+}
+
+SymbolLabel TemplateBank::whatSymbols(const cv::Mat& source) const {
+	TRACE_SCOPE("whatSymbols");
+
+	double maxResult=0.0;
+	int indice = 0;
+	// Symbole le plus ressemblant
+	for (int i = 0; i < symbolTemplates.size();i++) {
+		cv::Mat result;
+		matchTemplate(source, symbolTemplates[i], result, CV_TM_CCOEFF_NORMED);
+		//permet la rcupration du point d'intrt (haut a gauche) le plus probable
+		double min, max;
+		cv::Point locationMin;
+		cv::Point locationMax;
+		minMaxLoc(result, &min, &max, &locationMin, &locationMax);
+
+		if (max>maxResult) {
+			maxResult = max;
+			indice = i;
+		}
+	}
+
+	// taille de l'image
+
+	double maxResult1 = 0.0;
+	int couleur= 0;
+	// Symbole le plus ressemblant
+	for (int i = 0; i < sizeTemplates.size(); i++) {
+		cv::Mat result;
+		matchTemplate(source, sizeTemplates[i], result, CV_TM_CCOEFF_NORMED);
+
+		//permet la rcupration du point d'intrt (haut a gauche) le plus probable
+		double min, max;
+		cv::Point locationMin;
+		cv::Point locationMax;
+		minMaxLoc(result, &min, &max, &locationMin, &locationMax);
+		if (max>maxResult1) {
+			maxResult1 = max;
+			couleur= i;
+		}
+	}
+
+	SymbolLabel label = { symbolNames[indice], sizeNames[couleur] };
+	return label;
+
+}
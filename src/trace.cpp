@@ -0,0 +1,136 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "trace.hpp"
+
+struct TraceEvent {
+	const char* name;
+	const char* argName;
+	int64_t arg;      // value of a counter
+	int64_t start;    // ns
+	int64_t duration; // ns, -1 for a counter
+};
+
+struct ThreadBuffer {
+	int id;
+	std::string name;
+	std::vector<TraceEvent> events;
+	std::atomic<uint64_t> written; // total, the ring holds the last events.size()
+};
+
+std::atomic<bool> Tracer::enabled(false);
+
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ThreadBuffer> > buffers; // kept after their thread exits
+static std::vector<ThreadBuffer*> freeBuffers;              // of the threads that exited
+static size_t bufferCapacity = 1 << 16;
+static std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+// Gives the buffer of the thread back when it exits. The next new thread
+// records into it after the events already there: a thread per connection
+// reuses the same few buffers instead of adding one each.
+struct BufferOwner {
+	ThreadBuffer* buffer = NULL;
+	~BufferOwner() {
+		if (buffer == NULL) return;
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		freeBuffers.push_back(buffer);
+	}
+};
+
+static ThreadBuffer& threadBuffer() {
+	thread_local BufferOwner owner;
+	if (owner.buffer != NULL) return *owner.buffer;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	if (!freeBuffers.empty()) {
+		owner.buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+		return *owner.buffer;
+	}
+	buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+	owner.buffer = buffers.back().get();
+	owner.buffer->id = (int)buffers.size();
+	owner.buffer->events.resize(bufferCapacity);
+	owner.buffer->written = 0;
+	return *owner.buffer;
+}
+
+void Tracer::enable(size_t eventsPerThread) {
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		if (eventsPerThread > 0) bufferCapacity = eventsPerThread;
+		origin = std::chrono::steady_clock::now();
+	}
+	enabled = true;
+}
+
+int64_t Tracer::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Tracer::record(const char* name, const char* argName, int64_t arg, int64_t start, int64_t duration) {
+	ThreadBuffer& buffer = threadBuffer();
+	uint64_t n = buffer.written.load(std::memory_order_relaxed);
+	TraceEvent& event = buffer.events[n % buffer.events.size()];
+	event.name = name;
+	event.argName = argName;
+	event.arg = arg;
+	event.start = start;
+	event.duration = duration;
+	buffer.written.store(n + 1, std::memory_order_release);
+}
+
+void Tracer::setThreadName(const std::string& name) {
+	if (!isEnabled()) return;
+	ThreadBuffer& buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffer.name = name;
+}
+
+static void writeJsonString(FILE* file, const std::string& s) {
+	std::fputc('"', file);
+	for (char c : s) {
+		if (c == '"' || c == '\\') std::fputc('\\', file);
+		if ((unsigned char)c >= 0x20) std::fputc(c, file);
+	}
+	std::fputc('"', file);
+}
+
+bool Tracer::exportChromeTrace(const std::string& path) {
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (file == NULL) return false;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (auto& buffer : buffers) {
+		std::fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+			first ? "" : ",\n", buffer->id);
+		writeJsonString(file, buffer->name.empty() ? "thread " + std::to_string(buffer->id) : buffer->name);
+		std::fprintf(file, "}}");
+		first = false;
+
+		uint64_t written = buffer->written.load(std::memory_order_acquire);
+		uint64_t capacity = buffer->events.size();
+		uint64_t begin = written > capacity ? written - capacity : 0;
+		for (uint64_t i = begin; i < written; i++) {
+			const TraceEvent& event = buffer->events[i % capacity];
+			// trace_event timestamps are in microseconds
+			if (event.duration < 0) {
+				std::fprintf(file, ",\n{\"ph\":\"C\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+					event.name, buffer->id, event.start / 1000., (long long)event.arg);
+				continue;
+			}
+			std::fprintf(file, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				event.name, buffer->id, event.start / 1000., event.duration / 1000.);
+			if (event.argName != NULL) std::fprintf(file, ",\"args\":{\"%s\":%lld}", event.argName, (long long)event.arg);
+			std::fprintf(file, "}");
+		}
+	}
+	std::fprintf(file, "\n]}\n");
+	return std::fclose(file) == 0;
+}
@@ -0,0 +1,63 @@
+#include <math.h>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "gridCells.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+
+// quad approximation of a contour, false when it isn't a large enough rectangle
+static bool approxCell(const vector<cv::Point>& contour, double minArea, square_t& quad)
+{
+	approxPolyDP(cv::Mat(contour), quad, arcLength(cv::Mat(contour), true) * 0.02, true);
+	return quad.size() == 4
+		&& fabs(contourArea(cv::Mat(quad))) > minArea
+		&& isContourConvex(cv::Mat(quad))
+		&& maxQuadCosine(quad) < 0.3;
+}
+
+void findGridCellsTree(const cv::Mat& image, vector<square_t>& squares, const DetectionConfig& config)
+{
+	TRACE_SCOPE("findGridCellsTree");
+	squares.clear();
+
+	cv::Mat ink;
+	binarizeInk(image, ink);
+
+	// one pass: the lines of a grid make one outer contour, its holes are the cells
+	vector<vector<cv::Point> > contours;
+	vector<cv::Vec4i> hierarchy; // next, previous, first child, parent
+	findContours(ink, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+	Tracer::counter("contours", contours.size());
+
+	size_t grids = 0;
+	for (size_t i = 0; i < contours.size(); i++)
+	{
+		if (hierarchy[i][2] < 0) continue;
+
+		// direct children of contour i, the siblings of its first child
+		vector<square_t> cells;
+		int children = 0;
+		for (int child = hierarchy[i][2]; child >= 0; child = hierarchy[child][0])
+		{
+			children++;
+			square_t quad;
+			if (approxCell(contours[child], config.minContourArea, quad)) cells.push_back(quad);
+		}
+
+		// a grid: mostly quads, of regular size
+		if ((int)cells.size() < config.minGridCells || cells.size() * 2 < (size_t)children) continue;
+		keepRegularCells(cells, config.gridRegularity);
+		if ((int)cells.size() < config.minGridCells) continue;
+
+		grids++;
+		squares.insert(squares.end(), cells.begin(), cells.end());
+	}
+
+	sortCellsByRow(squares);
+	Tracer::counter("grids", grids);
+	Tracer::counter("squares found", squares.size());
+}
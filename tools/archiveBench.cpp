@@ -0,0 +1,154 @@
+// Compares the per-file output layout (png + txt per cell) with the packed
+// archive: write throughput, then random read throughput.
+// The crops are encoded beforehand so that only the layouts are measured.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include "cellArchive.hpp"
+
+using namespace std;
+
+struct BenchCell {
+	CellInfo info;
+	vector<uchar> png;
+};
+
+static double seconds(int64 start)
+{
+	return (cv::getTickCount() - start) / cv::getTickFrequency();
+}
+
+static void report(const string& what, size_t cells, size_t bytes, double elapsed)
+{
+	cout << what << ": " << cells << " cells in " << elapsed * 1000 << " ms, "
+		<< cells / elapsed << " cells/s, " << bytes / elapsed / (1 << 20) << " MB/s" << endl;
+}
+
+static bool writeWholeFile(const string& path, const void* data, size_t size)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == NULL) return false;
+	bool ok = fwrite(data, 1, size, file) == size;
+	return fclose(file) == 0 && ok;
+}
+
+static bool readWholeFile(const string& path, vector<uchar>& out)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL) return false;
+	fseek(file, 0, SEEK_END);
+	out.resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	bool ok = fread(out.data(), 1, out.size(), file) == out.size();
+	fclose(file);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		cout << "Usage: archive_bench <page.png> <existing output dir> [cells=2000] [reads=2000]" << endl;
+		return 1;
+	}
+	string pagePath = argv[1];
+	string directory = argv[2];
+	int numCells = argc > 3 ? atoi(argv[3]) : 2000;
+	int numReads = argc > 4 ? atoi(argv[4]) : 2000;
+	if (numCells <= 0 || numReads < 0) {
+		cout << "cells must be positive and reads not negative" << endl;
+		return 1;
+	}
+
+	cv::Mat page = cv::imread(pagePath);
+	if (page.empty() || page.cols < 250 || page.rows < 250) {
+		cout << "Couldn't load " << pagePath << endl;
+		return 1;
+	}
+
+	// cell sized crops taken at random on the page
+	mt19937 rng(42);
+	uniform_int_distribution<int> randomX(0, page.cols - 250), randomY(0, page.rows - 250);
+	vector<BenchCell> cells(numCells);
+	size_t totalBytes = 0;
+	for (int i = 0; i < numCells; i++) {
+		BenchCell& cell = cells[i];
+		cell.info.label = "bench";
+		cell.info.size = "small";
+		cell.info.scripter = "000";
+		cell.info.page = to_string(i / 100);
+		cell.info.row = i % 100 / 10 + 1;
+		cell.info.column = i % 10 + 1;
+		cv::imencode(".png", page(cv::Rect(randomX(rng), randomY(rng), 250, 250)), cell.png);
+		totalBytes += cell.png.size();
+	}
+
+	// WRITE
+	int64 start = cv::getTickCount();
+	for (BenchCell& cell : cells) {
+		string path = directory + "/" + getFileName(cell.info);
+		string metadata = getMetadataText(cell.info);
+		writeWholeFile(path + ".png", cell.png.data(), cell.png.size());
+		writeWholeFile(path + ".txt", metadata.data(), metadata.size());
+	}
+	report("files   write", cells.size(), totalBytes, seconds(start));
+
+	string base = directory + "/bench";
+	remove((base + ".pack").c_str());
+	remove((base + ".idx").c_str());
+	start = cv::getTickCount();
+	{
+		ArchiveWriter archive;
+		archive.open(base);
+		for (BenchCell& cell : cells) {
+			archive.append(cell.info, cell.png.data(), cell.png.size());
+		}
+		archive.close();
+	}
+	report("archive write", cells.size(), totalBytes, seconds(start));
+
+	// RANDOM READ
+	vector<int> order(numReads);
+	uniform_int_distribution<int> randomCell(0, numCells - 1);
+	for (int& i : order) i = randomCell(rng);
+
+	vector<uchar> buffer;
+	size_t readBytes = 0;
+	start = cv::getTickCount();
+	for (int i : order) {
+		readWholeFile(directory + "/" + getFileName(cells[i].info) + ".png", buffer);
+		readBytes += buffer.size();
+	}
+	report("files   read ", order.size(), readBytes, seconds(start));
+
+	readBytes = 0;
+	start = cv::getTickCount();
+	{
+		ArchiveReader reader;
+		if (!reader.open(base)) {
+			cout << "Couldn't open " << base << endl;
+			return 1;
+		}
+		for (int i : order) {
+			const ArchiveRecord* record = reader.find(getFileName(cells[i].info));
+			if (record == NULL) continue;
+			// copied so that the pages of the mapping are actually read
+			const unsigned char* bytes = reader.data(*record);
+			if (bytes == NULL) continue;
+			buffer.assign(bytes, bytes + record->length);
+			readBytes += buffer.size();
+		}
+	}
+	report("archive read ", order.size(), readBytes, seconds(start));
+
+	cout << "(drop the page cache between runs to measure cold reads)" << endl;
+	return 0;
+}
@@ -0,0 +1,97 @@
+// Lists and extracts the cells of a packed archive shard
+// (<base>.pack + <base>.idx written by my_project -format=archive)
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "cellArchive.hpp"
+
+using namespace std;
+
+static void help()
+{
+	cout <<
+		"Usage:\n"
+		"  archive_tool list <base>                 list the cells of the shard\n"
+		"  archive_tool extract <base> <dir> [key]  write the cells (png + txt) to dir,\n"
+		"                                           all of them or only key\n"
+		<< endl;
+}
+
+static bool extractCell(const ArchiveReader& reader, const ArchiveRecord& record, const string& directory)
+{
+	const unsigned char* bytes = reader.data(record);
+	if (bytes == NULL) return false;
+
+	CellInfo cell = ArchiveReader::toCellInfo(record);
+	string path = directory + "/" + getFileName(cell);
+
+	// the crop is already encoded, no need to decode it; a blank cell has none
+	bool ok = true;
+	if (record.length > 0) {
+		FILE* png = fopen((path + ".png").c_str(), "wb");
+		if (png == NULL) return false;
+		ok = fwrite(bytes, 1, record.length, png) == record.length;
+		ok = fclose(png) == 0 && ok;
+	}
+
+	string metadata = getMetadataText(cell);
+	FILE* txt = fopen((path + ".txt").c_str(), "wb");
+	if (txt == NULL) return false;
+	ok = fwrite(metadata.data(), 1, metadata.size(), txt) == metadata.size() && ok;
+	ok = fclose(txt) == 0 && ok;
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		help();
+		return 1;
+	}
+	string command = argv[1];
+	string base = argv[2];
+
+	ArchiveReader reader;
+	if (!reader.open(base)) {
+		cout << "Couldn't open " << base << ".idx / .pack" << endl;
+		return 1;
+	}
+
+	if (command == "list") {
+		for (size_t i = 0; i < reader.size(); i++) {
+			const ArchiveRecord& record = reader.record(i);
+			CellInfo cell = ArchiveReader::toCellInfo(record);
+			cout << getFileName(cell) << " " << record.offset << " " << record.length << " "
+				<< cell.label << " " << cell.size << " " << cell.scripter << " " << cell.page << " "
+				<< cell.row << " " << cell.column << endl;
+		}
+		return 0;
+	}
+
+	if (command == "extract" && argc >= 4) {
+		string directory = argv[3];
+		int errors = 0;
+
+		if (argc >= 5) {
+			const ArchiveRecord* record = reader.find(argv[4]);
+			if (record == NULL) {
+				cout << argv[4] << " is not in " << base << endl;
+				return 1;
+			}
+			errors += !extractCell(reader, *record, directory);
+		}
+		else {
+			for (size_t i = 0; i < reader.size(); i++) {
+				errors += !extractCell(reader, reader.record(i), directory);
+			}
+		}
+
+		if (errors > 0) cout << errors << " cells couldn't be extracted" << endl;
+		return errors > 0 ? 1 : 0;
+	}
+
+	help();
+	return 1;
+}
@@ -0,0 +1,193 @@
+// Searches the smallest set of findSquares passes (color plane + threshold
+// level) that still finds the same cells as every pass on a sample of
+// pages, then writes the tuned detection configuration.
+// The squares of each pass are computed once per page; a candidate set
+// only reruns the filters on the union of its passes.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include "detectionConfig.hpp"
+#include "pageLoader.hpp"
+#include "pipeline.hpp"
+
+using namespace std;
+
+static const char* keys =
+	"{help h   |      | print this message}"
+	"{@images  |images/| sample pages: a directory, a .txt listing one page per line or a .png}"
+	"{@output  |tuned.yml| tuned configuration (.yml, .xml or .json)}"
+	"{config   |      | configuration to tune, its passes are ignored}"
+	"{sample   |20    | number of pages of the sample, spread over the inputs}";
+
+struct SampleCell {
+	int row, column;
+	cv::Rect rect;
+
+	bool operator==(const SampleCell& other) const {
+		return row == other.row && column == other.column && rect == other.rect;
+	}
+};
+
+struct SamplePage {
+	string path;
+	vector<vector<square_t>> passSquares; // squares found by each pass
+	vector<SampleCell> expected;          // cells found with every pass
+};
+
+// cells found by the passes of mask, as detectCells would
+static vector<SampleCell> cellsOf(const SamplePage& page, uint32_t mask, const DetectionConfig& config)
+{
+	vector<square_t> squares;
+	for (size_t p = 0; p < page.passSquares.size(); p++) {
+		if (mask & (1u << p)) squares.insert(squares.end(), page.passSquares[p].begin(), page.passSquares[p].end());
+	}
+
+	vector<square_t> squaresBis;
+	filterBySize(squares, squaresBis, config.minSquareWidth, config.maxSquareWidth);
+	rotateSquares(squaresBis);
+	vector<square_t> filtered;
+	filterOverlappingSquares(squaresBis, filtered, config.overlapTolX, config.overlapTolY);
+
+	vector<SampleCell> cells;
+	if (filtered.empty()) return cells;
+	vector<vector<square_t>> rows = groupByRow(filtered, config.rowTolerance);
+	for (size_t k = 0; k < rows.size(); k++) {
+		for (size_t u = 0; u < rows[k].size(); u++) {
+			SampleCell cell = { (int)k + 1, (int)u + 1, cv::Rect(rows[k][u][0], rows[k][u][2]) };
+			cells.push_back(cell);
+		}
+	}
+	return cells;
+}
+
+static bool findsSameCells(const vector<SamplePage>& pages, uint32_t mask, const DetectionConfig& config)
+{
+	for (const SamplePage& page : pages) {
+		if (!(cellsOf(page, mask, config) == page.expected)) return false;
+	}
+	return true;
+}
+
+static int countBits(uint32_t mask)
+{
+	int n = 0;
+	for (; mask; mask &= mask - 1) n++;
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	cv::CommandLineParser parser(argc, argv, keys);
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	const string outputPath = parser.get<cv::String>("@output");
+	const int sampleSize = max(1, parser.get<int>("sample"));
+
+	DetectionConfig config;
+	if (!loadConfigOption(parser, config)) return 1;
+	if (config.engine != "contours")
+	{
+		cout << "Only the passes of the contours engine can be tuned" << endl;
+		return 1;
+	}
+	// cellsOf replays the filters of detectCells on the squares of the full page:
+	// the pages rescaled, straightened or with passes chosen per page would be scored
+	// on another pipeline than the one running the tuned passes
+	if (config.estimateScale || config.detectionScale != 1 || config.deskew || config.adaptiveLevels)
+	{
+		cout << "The passes can't be tuned with estimateScale, detectionScale, deskew or adaptiveLevels set" << endl;
+		return 1;
+	}
+	config.passes.clear();
+	const vector<DetectionPass> allPasses = config.activePasses();
+	if (allPasses.size() > 20)
+	{
+		cout << "Too many passes to search: " << allPasses.size() << endl;
+		return 1;
+	}
+	const uint32_t everyPass = (uint32_t)((1ull << allPasses.size()) - 1);
+
+	// pages spread over the inputs
+	vector<string> inputs = PageLoader::listInputs(parser.get<cv::String>("@images"));
+	vector<SamplePage> pages;
+	vector<double> passMs(allPasses.size(), 0);
+	size_t step = max<size_t>(1, inputs.size() / sampleSize);
+	for (size_t i = 0; i < inputs.size() && pages.size() < (size_t)sampleSize; i += step)
+	{
+		cv::Mat image = cv::imread(inputs[i]);
+		if (image.empty()) continue;
+
+		SamplePage page;
+		page.path = inputs[i];
+		page.passSquares.resize(allPasses.size());
+		cv::Mat plane;
+		int extracted = -1;
+		for (size_t p = 0; p < allPasses.size(); p++)
+		{
+			if (allPasses[p].channel != extracted)
+			{
+				extracted = allPasses[p].channel;
+				extractPlane(image, extracted, plane);
+			}
+			int64 start = cv::getTickCount();
+			findSquaresInPlane(plane, allPasses[p].level, page.passSquares[p], config);
+			passMs[p] += (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+		}
+		page.expected = cellsOf(page, everyPass, config);
+		cout << page.path << ": " << page.expected.size() << " cells" << endl;
+		pages.push_back(page);
+	}
+	if (pages.empty())
+	{
+		cout << "No page to tune on" << endl;
+		return 1;
+	}
+
+	// smallest sets first, the cheapest of the smallest sets that work
+	uint32_t best = everyPass;
+	for (size_t size = 1; size < allPasses.size() && best == everyPass; size++)
+	{
+		double bestMs = -1;
+		for (uint32_t mask = 1; mask < everyPass; mask++)
+		{
+			if (countBits(mask) != (int)size) continue;
+			double ms = 0;
+			for (size_t p = 0; p < allPasses.size(); p++) if (mask & (1u << p)) ms += passMs[p];
+			if (bestMs >= 0 && ms >= bestMs) continue;
+			if (!findsSameCells(pages, mask, config)) continue;
+			best = mask;
+			bestMs = ms;
+		}
+	}
+
+	double totalMs = 0, tunedMs = 0;
+	for (size_t p = 0; p < allPasses.size(); p++)
+	{
+		totalMs += passMs[p];
+		if (!(best & (1u << p))) continue;
+		tunedMs += passMs[p];
+		config.passes.push_back(allPasses[p]);
+		cout << "pass channel " << allPasses[p].channel << " level " << allPasses[p].level
+			<< ": " << passMs[p] / pages.size() << " ms/page" << endl;
+	}
+	cout << config.passes.size() << "/" << allPasses.size() << " passes, findSquares "
+		<< totalMs / pages.size() << " -> " << tunedMs / pages.size() << " ms/page on " << pages.size() << " pages" << endl;
+
+	if (!config.save(outputPath))
+	{
+		cout << "Couldn't write " << outputPath << endl;
+		return 1;
+	}
+	cout << "configuration: " << outputPath << endl;
+	return 0;
+}
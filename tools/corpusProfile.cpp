@@ -0,0 +1,264 @@
+// Scan quality profile of a corpus, to run before a long batch: pages are
+// decoded at a reduced resolution, their BGR and HSV histograms computed in
+// parallel then summed per scripter by a tree reduction. Writes a compact
+// report and, for each scripter, a detection configuration for -config.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include "detectionConfig.hpp"
+#include "histogram.hpp"
+#include "pageLoader.hpp"
+
+using namespace std;
+
+static const char* keys =
+	"{help h   |      | print this message}"
+	"{@images  |images/| pages: a directory, a .txt listing one page per line or a .png}"
+	"{@output  |profile/| existing directory of the report and of the configurations}"
+	"{config   |      | base configuration of the suggested ones}"
+	"{reduce   |4     | decoding resolution divisor: 1, 2, 4 or 8}"
+	"{contrast |100   | value spread (5th to 95th percentile) under which pages are faint}"
+	"{bright   |235   | mean value over which pages with little ink are overexposed}"
+	"{saturation|40   | mean saturation over which pages are colour shifted}";
+
+struct PageHistograms {
+	ChannelHistograms bgr, hsv;
+
+	void add(const PageHistograms& other) {
+		addHistograms(bgr, other.bgr);
+		addHistograms(hsv, other.hsv);
+	}
+};
+
+struct PageProfile {
+	string path;
+	string scripter;
+	bool loaded = false;
+	PageHistograms hist;
+};
+
+struct Summary {
+	double brightness = 0;     // mean value
+	double contrast = 0;       // 95th - 5th percentile of the value
+	double saturation = 0;     // mean saturation
+	double darkRatio = 0;      // pixels under the Otsu threshold of the value
+	double separability[3] = { 0, 0, 0 }; // Otsu criterion of the B, G and R planes
+	bool faint = false, overexposed = false, colourShifted = false;
+};
+
+struct Thresholds {
+	double contrast, brightness, saturation;
+};
+
+static string scripterOf(const string& path)
+{
+	std::regex rgx(".*/w(\\d\\d\\d)-scans/.+");
+	std::smatch matches;
+	return std::regex_match(path, matches, rgx) ? string(matches[1]) : string("unknown");
+}
+
+static double mean(const vector<uint32_t>& counts)
+{
+	double total = 0, sum = 0;
+	for (size_t b = 0; b < counts.size(); b++) {
+		total += counts[b];
+		sum += (double)b * counts[b];
+	}
+	return total > 0 ? sum / total : 0;
+}
+
+// bin under which fraction q of the pixels fall
+static int percentile(const vector<uint32_t>& counts, double q)
+{
+	double total = 0;
+	for (uint32_t count : counts) total += count;
+	double seen = 0;
+	for (size_t b = 0; b < counts.size(); b++) {
+		seen += counts[b];
+		if (seen >= q * total) return (int)b;
+	}
+	return (int)counts.size() - 1;
+}
+
+static Summary summarize(const PageHistograms& hist, const Thresholds& limits)
+{
+	Summary s;
+	const vector<uint32_t>& value = hist.hsv.counts[2];
+	s.brightness = mean(value);
+	s.contrast = percentile(value, 0.95) - percentile(value, 0.05);
+	s.saturation = mean(hist.hsv.counts[1]);
+
+	int threshold = otsuThreshold(value);
+	double total = 0, dark = 0;
+	for (size_t b = 0; b < value.size(); b++) {
+		total += value[b];
+		if ((int)b < threshold) dark += value[b];
+	}
+	s.darkRatio = total > 0 ? dark / total : 0;
+	for (int c = 0; c < 3; c++) otsuThreshold(hist.bgr.counts[c], &s.separability[c]);
+
+	s.faint = s.contrast < limits.contrast;
+	s.overexposed = s.brightness > limits.brightness && s.darkRatio < 0.02;
+	s.colourShifted = s.saturation > limits.saturation;
+	return s;
+}
+
+// sums parts into parts[0]: log2(n) levels, the pairs of a level in parallel
+static void treeReduce(vector<PageHistograms>& parts)
+{
+	for (size_t stride = 1; stride < parts.size(); stride *= 2) {
+		int pairs = (int)((parts.size() + 2 * stride - 1) / (2 * stride));
+		cv::parallel_for_(cv::Range(0, pairs), [&](const cv::Range& range) {
+			for (int i = range.start; i < range.end; i++) {
+				size_t a = i * 2 * stride, b = a + stride;
+				if (b < parts.size()) parts[a].add(parts[b]);
+			}
+		});
+	}
+}
+
+// detection settings for the pages of a scripter
+static DetectionConfig suggestConfig(const DetectionConfig& base, const Summary& s)
+{
+	DetectionConfig config = base;
+	if (s.faint || s.overexposed) {
+		// the ink is close to the paper: every threshold level is needed
+		config.adaptiveLevels = false;
+		config.passes.clear();
+		return config;
+	}
+	if (s.colourShifted) {
+		// only the planes where ink and paper separate
+		vector<DetectionPass> passes;
+		for (const DetectionPass& pass : base.activePasses()) {
+			if (s.separability[pass.channel] >= base.minSeparability) passes.push_back(pass);
+		}
+		if (!passes.empty()) config.passes = passes;
+		return config;
+	}
+	// clean scans: the histogram of each page picks its levels
+	config.adaptiveLevels = true;
+	return config;
+}
+
+static void writeSummary(cv::FileStorage& fs, const Summary& s)
+{
+	fs << "brightness" << s.brightness << "contrast" << s.contrast << "saturation" << s.saturation
+		<< "darkRatio" << s.darkRatio;
+	fs << "separability" << "[:" << s.separability[0] << s.separability[1] << s.separability[2] << "]";
+	fs << "faint" << (int)s.faint << "overexposed" << (int)s.overexposed << "colourShifted" << (int)s.colourShifted;
+}
+
+int main(int argc, char** argv)
+{
+	cv::CommandLineParser parser(argc, argv, keys);
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	string outputDirectory = parser.get<cv::String>("@output");
+	if (!outputDirectory.empty() && outputDirectory.back() != '/' && outputDirectory.back() != '\\') outputDirectory += "/";
+
+	DetectionConfig base;
+	if (!loadConfigOption(parser, base)) return 1;
+
+	int readFlags = cv::IMREAD_COLOR;
+	switch (parser.get<int>("reduce")) {
+	case 1: break;
+	case 2: readFlags = cv::IMREAD_REDUCED_COLOR_2; break;
+	case 4: readFlags = cv::IMREAD_REDUCED_COLOR_4; break;
+	case 8: readFlags = cv::IMREAD_REDUCED_COLOR_8; break;
+	default:
+		cout << "reduce must be 1, 2, 4 or 8" << endl;
+		return 1;
+	}
+	const Thresholds limits = { parser.get<double>("contrast"), parser.get<double>("bright"), parser.get<double>("saturation") };
+
+	vector<string> inputs = PageLoader::listInputs(parser.get<cv::String>("@images"));
+	vector<PageProfile> pages(inputs.size());
+	int64 start = cv::getTickCount();
+	cv::parallel_for_(cv::Range(0, (int)pages.size()), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; i++) {
+			PageProfile& page = pages[i];
+			page.path = inputs[i];
+			page.scripter = scripterOf(page.path);
+			cv::Mat image = cv::imread(page.path, readFlags);
+			if (image.empty()) continue;
+			page.hist.bgr = computeChannelHistograms(image);
+			page.hist.hsv = computeHsvHistograms(image);
+			page.loaded = true;
+		}
+	});
+	double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+	// per page, and the histograms of each scripter
+	map<string, vector<PageHistograms>> byScripter;
+	ofstream pagesCsv(outputDirectory + "pages.csv");
+	pagesCsv << "path,scripter,brightness,contrast,saturation,dark,separability_b,separability_g,separability_r,faint,overexposed,colour_shifted\n";
+	size_t loaded = 0;
+	for (PageProfile& page : pages)
+	{
+		if (!page.loaded)
+		{
+			cout << "Couldn't load " << page.path << endl;
+			continue;
+		}
+		loaded++;
+		Summary s = summarize(page.hist, limits);
+		pagesCsv << page.path << ',' << page.scripter << ',' << s.brightness << ',' << s.contrast << ',' << s.saturation << ','
+			<< s.darkRatio << ',' << s.separability[0] << ',' << s.separability[1] << ',' << s.separability[2] << ','
+			<< s.faint << ',' << s.overexposed << ',' << s.colourShifted << '\n';
+		byScripter[page.scripter].push_back(std::move(page.hist));
+	}
+	if (!pagesCsv)
+	{
+		cout << "Couldn't write " << outputDirectory << "pages.csv" << endl;
+		return 1;
+	}
+
+	cv::FileStorage report(outputDirectory + "profile.yml", cv::FileStorage::WRITE);
+	if (!report.isOpened())
+	{
+		cout << "Couldn't write " << outputDirectory << "profile.yml" << endl;
+		return 1;
+	}
+	report << "pages" << (int)loaded << "reduce" << parser.get<int>("reduce");
+	report << "scripters" << "[";
+	for (auto& entry : byScripter)
+	{
+		size_t count = entry.second.size();
+		treeReduce(entry.second);
+		Summary s = summarize(entry.second[0], limits);
+
+		string configName = "w" + entry.first + ".yml";
+		if (!suggestConfig(base, s).save(outputDirectory + configName))
+		{
+			cout << "Couldn't write " << outputDirectory << configName << endl;
+			return 1;
+		}
+
+		report << "{" << "scripter" << entry.first << "pages" << (int)count;
+		writeSummary(report, s);
+		report << "config" << configName << "}";
+
+		cout << "w" << entry.first << ": " << count << " pages, brightness " << s.brightness << ", contrast " << s.contrast
+			<< ", saturation " << s.saturation << (s.faint ? ", faint" : "") << (s.overexposed ? ", overexposed" : "")
+			<< (s.colourShifted ? ", colour shifted" : "") << " -> " << configName << endl;
+	}
+	report << "]";
+	report.release();
+
+	cout << loaded << " pages in " << seconds << " s, report: " << outputDirectory << "profile.yml" << endl;
+	return 0;
+}
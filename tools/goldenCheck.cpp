@@ -0,0 +1,288 @@
+// Golden output regression harness: runs the pipeline on sample pages and
+// compares the cells found with stored golden files.
+// A cell matches when its rectangle is within the tolerance; its label,
+// size and, for an identical rectangle, the hash of its crop must be equal.
+// Several engines can be checked side by side against the same golden files.
+// check exits with 77 (skipped, for CTest) when no golden file was recorded yet.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include "hashing.hpp"
+#include "pageProcessor.hpp"
+
+using namespace std;
+
+static const char* keys =
+	"{help h   |      | print this message}"
+	"{@command |check | record: write the golden files, check: compare with them}"
+	"{@images  |images/| directory of the sample pages (*.png)}"
+	"{@golden  |images/golden/| existing directory of the golden files}"
+	"{engines  |contours| engines to check, comma separated (record uses the first one)}"
+	"{config   |      | detection configuration of the engines}"
+	"{templates|images/templates/| directory of the symbol and size templates}"
+	"{tolerance|1     | pixels a rectangle may move}";
+
+struct GoldenCell {
+	int row, column;
+	cv::Rect rect;
+	string label, size;
+	uint64_t cropHash;
+};
+
+static string pageName(const string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	string name = slash == string::npos ? path : path.substr(slash + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+static vector<GoldenCell> runPipeline(const cv::Mat& image, const PageProcessor& processor)
+{
+	vector<GoldenCell> cells;
+	PageCells page = processor.process(image);
+	for (const DetectedCell& found : page.cells)
+	{
+		GoldenCell cell = { found.row, found.column, found.rect, found.label.name, found.label.size,
+			hashImage(page.crop(image, found.rect)) };
+		cells.push_back(cell);
+	}
+	return cells;
+}
+
+static bool writeGolden(const string& path, const string& engine, const vector<GoldenCell>& cells)
+{
+	ofstream file(path);
+	file << "# engine " << engine << "\n# row column x y width height label size crop_hash\n";
+	for (const GoldenCell& cell : cells)
+	{
+		file << cell.row << ' ' << cell.column << ' ' << cell.rect.x << ' ' << cell.rect.y << ' '
+			<< cell.rect.width << ' ' << cell.rect.height << ' ' << cell.label << ' ' << cell.size << ' '
+			<< hex << cell.cropHash << dec << '\n';
+	}
+	file.close();
+	return !file.fail();
+}
+
+static bool readGolden(const string& path, vector<GoldenCell>& cells)
+{
+	ifstream file(path);
+	if (!file) return false;
+
+	string line;
+	while (getline(file, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+		istringstream fields(line);
+		GoldenCell cell;
+		fields >> cell.row >> cell.column >> cell.rect.x >> cell.rect.y >> cell.rect.width >> cell.rect.height
+			>> cell.label >> cell.size >> hex >> cell.cropHash;
+		if (!fields) return false;
+		cells.push_back(cell);
+	}
+	return true;
+}
+
+static string describe(const GoldenCell& cell)
+{
+	ostringstream out;
+	out << "r" << cell.row << " c" << cell.column << " [" << cell.rect.x << "," << cell.rect.y << " "
+		<< cell.rect.width << "x" << cell.rect.height << "] " << cell.label << "/" << cell.size;
+	return out.str();
+}
+
+static int rectDistance(const cv::Rect& a, const cv::Rect& b)
+{
+	return max(max(abs(a.x - b.x), abs(a.y - b.y)), max(abs(a.width - b.width), abs(a.height - b.height)));
+}
+
+// prints the differences, returns their number
+static int compareCells(const vector<GoldenCell>& golden, const vector<GoldenCell>& found, int tolerance, ostream& report)
+{
+	int differences = 0;
+	vector<bool> used(found.size(), false);
+
+	for (const GoldenCell& expected : golden)
+	{
+		int best = -1, bestDistance = tolerance + 1;
+		for (size_t i = 0; i < found.size(); i++)
+		{
+			int distance = rectDistance(expected.rect, found[i].rect);
+			if (!used[i] && distance < bestDistance)
+			{
+				best = (int)i;
+				bestDistance = distance;
+			}
+		}
+		if (best < 0)
+		{
+			report << "    missing  " << describe(expected) << "\n";
+			differences++;
+			continue;
+		}
+		used[best] = true;
+
+		const GoldenCell& actual = found[best];
+		if (actual.row != expected.row || actual.column != expected.column)
+		{
+			report << "    moved    " << describe(expected) << " -> r" << actual.row << " c" << actual.column << "\n";
+			differences++;
+		}
+		if (actual.label != expected.label || actual.size != expected.size)
+		{
+			report << "    label    " << describe(expected) << " -> " << actual.label << "/" << actual.size << "\n";
+			differences++;
+		}
+		if (actual.rect == expected.rect && actual.cropHash != expected.cropHash)
+		{
+			report << "    pixels   " << describe(expected) << " crop hash " << hex << expected.cropHash
+				<< " -> " << actual.cropHash << dec << "\n";
+			differences++;
+		}
+	}
+	for (size_t i = 0; i < found.size(); i++)
+	{
+		if (used[i]) continue;
+		report << "    extra    " << describe(found[i]) << "\n";
+		differences++;
+	}
+	return differences;
+}
+
+int main(int argc, char** argv)
+{
+	cv::CommandLineParser parser(argc, argv, keys);
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	const string command = parser.get<cv::String>("@command");
+	const string imagesDirectory = parser.get<cv::String>("@images");
+	const string goldenDirectory = parser.get<cv::String>("@golden");
+	const int tolerance = parser.get<int>("tolerance");
+	if (command != "record" && command != "check")
+	{
+		cout << "Unknown command " << command << endl;
+		return 1;
+	}
+
+	shared_ptr<TemplateBank> templates = make_shared<TemplateBank>();
+	if (!templates->load(parser.get<cv::String>("templates"))) return 1;
+
+	// no symbol cache: the classifier itself is checked
+	vector<string> engines;
+	vector<unique_ptr<PageProcessor>> processors;
+	DetectionConfig baseConfig;
+	if (!loadConfigOption(parser, baseConfig)) return 1;
+	stringstream list(parser.get<cv::String>("engines"));
+	for (string engine; getline(list, engine, ',');)
+	{
+		if (engine.empty()) continue;
+		DetectionConfig config = baseConfig;
+		config.engine = engine;
+		processors.push_back(unique_ptr<PageProcessor>(new PageProcessor(config, templates, false)));
+		if (!processors.back()->isValid())
+		{
+			cout << "Unknown engine " << engine << endl;
+			return 1;
+		}
+		engines.push_back(engine);
+	}
+	if (engines.empty()) return 1;
+
+	vector<cv::String> pages;
+	cv::glob(imagesDirectory + "/*.png", pages, false);
+	if (pages.empty())
+	{
+		cout << "No page in " << imagesDirectory << endl;
+		return 1;
+	}
+
+	if (command == "record")
+	{
+		for (const cv::String& page : pages)
+		{
+			cv::Mat image = cv::imread(page);
+			if (image.empty()) continue;
+			vector<GoldenCell> cells = runPipeline(image, *processors[0]);
+			string path = goldenDirectory + "/" + pageName(page) + ".cells";
+			if (!writeGolden(path, engines[0], cells))
+			{
+				cout << "Couldn't write " << path << endl;
+				return 1;
+			}
+			cout << path << ": " << cells.size() << " cells" << endl;
+		}
+		return 0;
+	}
+
+	// nothing recorded yet: skipped rather than failed
+	bool anyGolden = false;
+	for (const cv::String& page : pages)
+	{
+		ifstream file(goldenDirectory + "/" + pageName(page) + ".cells");
+		anyGolden = anyGolden || file.good();
+	}
+	if (!anyGolden)
+	{
+		cout << "No golden file in " << goldenDirectory << ": run golden record first, with the reference OpenCV 3.3.1" << endl;
+		return 77;
+	}
+
+	bool passed = true;
+	ostringstream summary;
+	for (size_t e = 0; e < engines.size(); e++)
+	{
+		const string& engine = engines[e];
+		int failedPages = 0, totalDifferences = 0;
+		cout << "engine " << engine << endl;
+
+		for (const cv::String& page : pages)
+		{
+			vector<GoldenCell> golden;
+			string path = goldenDirectory + "/" + pageName(page) + ".cells";
+			if (!readGolden(path, golden))
+			{
+				cout << "  " << page << ": no golden file " << path << endl;
+				failedPages++;
+				continue;
+			}
+
+			cv::Mat image = cv::imread(page);
+			if (image.empty())
+			{
+				cout << "  " << page << ": couldn't load" << endl;
+				failedPages++;
+				continue;
+			}
+
+			int64 start = cv::getTickCount();
+			vector<GoldenCell> found = runPipeline(image, *processors[e]);
+			double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+
+			ostringstream report;
+			int differences = compareCells(golden, found, tolerance, report);
+			cout << "  " << page << ": " << (differences == 0 ? "ok" : to_string(differences) + " differences")
+				<< ", " << found.size() << "/" << golden.size() << " cells, " << ms << " ms" << endl
+				<< report.str();
+			if (differences > 0) failedPages++;
+			totalDifferences += differences;
+		}
+
+		summary << engine << ": " << (failedPages == 0 ? "PASS" : "FAIL") << ", "
+			<< pages.size() - failedPages << "/" << pages.size() << " pages, " << totalDifferences << " differences\n";
+		if (failedPages > 0) passed = false;
+	}
+	cout << endl << summary.str();
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+// Checks of the packed masks against OpenCV on random planes:
+// BitMask (threshold, dilation, unpacking, counts) against plane >= t and cv::dilate,
+// RunLengthMask components against connectedComponentsWithStats.
+// Prints the failed checks and exits with 1 when any fails.
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include "bitMask.hpp"
+#include "runLengthMask.hpp"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, int trial)
+{
+	if (ok) return;
+	printf("FAILED %s (trial %d)\n", what, trial);
+	failures++;
+}
+
+static bool sameMat(const cv::Mat& a, const cv::Mat& b)
+{
+	return a.size() == b.size() && a.type() == b.type() && (a.empty() || cv::norm(a, b, cv::NORM_INF) == 0);
+}
+
+// random plane: uniform noise, or blobs (blurred noise) that make large components
+static cv::Mat randomPlane(cv::RNG& rng, int trial)
+{
+	cv::Mat plane(rng.uniform(1, 150), rng.uniform(1, 300), CV_8U);
+	rng.fill(plane, cv::RNG::UNIFORM, 0, 256);
+	if (trial % 2) cv::GaussianBlur(plane, plane, cv::Size(7, 7), 0);
+	return plane;
+}
+
+static cv::Rect randomRoi(cv::RNG& rng, cv::Size size)
+{
+	int x = rng.uniform(0, size.width), y = rng.uniform(0, size.height);
+	return cv::Rect(x, y, rng.uniform(1, size.width - x + 1), rng.uniform(1, size.height - y + 1));
+}
+
+static void checkBitMask(const cv::Mat& plane, int threshold, cv::RNG& rng, int trial)
+{
+	cv::Mat expected = plane >= threshold;
+	BitMask mask = BitMask::fromThreshold(plane, threshold);
+	check(sameMat(mask.toMat(), expected), "BitMask::fromThreshold == plane >= t", trial);
+	check(mask.count() == cv::countNonZero(expected), "BitMask::count", trial);
+
+	cv::Rect roi = randomRoi(rng, plane.size());
+	check(sameMat(mask.toMat(roi), expected(roi)), "BitMask::toMat(roi)", trial);
+	check(mask.count(roi) == cv::countNonZero(expected(roi)), "BitMask::count(roi)", trial);
+
+	cv::Mat dilated;
+	cv::dilate(expected, dilated, cv::Mat());
+	check(sameMat(mask.dilated().toMat(), dilated), "BitMask::dilated == cv::dilate", trial);
+
+	// all the levels in one pass give the single level masks
+	vector<int> thresholds = { threshold, rng.uniform(0, 257), 0, 255 };
+	vector<BitMask> masks;
+	BitMask::fromThresholds(plane, thresholds, masks);
+	for (size_t i = 0; i < thresholds.size(); i++)
+	{
+		check(sameMat(masks[i].toMat(), plane >= thresholds[i]), "BitMask::fromThresholds", trial);
+	}
+}
+
+static bool byBoxAndArea(const RunLengthMask::Component& a, const RunLengthMask::Component& b)
+{
+	if (a.box.y != b.box.y) return a.box.y < b.box.y;
+	if (a.box.x != b.box.x) return a.box.x < b.box.x;
+	if (a.box.width != b.box.width) return a.box.width < b.box.width;
+	if (a.box.height != b.box.height) return a.box.height < b.box.height;
+	return a.area < b.area;
+}
+
+static void checkComponents(const RunLengthMask& runs, const cv::Mat& mask, bool eightConnected, int trial)
+{
+	cv::Mat labels, stats, centroids;
+	int count = cv::connectedComponentsWithStats(mask, labels, stats, centroids, eightConnected ? 8 : 4, CV_32S);
+	vector<RunLengthMask::Component> expected;
+	for (int label = 1; label < count; label++)
+	{
+		RunLengthMask::Component c;
+		c.box = cv::Rect(stats.at<int>(label, cv::CC_STAT_LEFT), stats.at<int>(label, cv::CC_STAT_TOP),
+			stats.at<int>(label, cv::CC_STAT_WIDTH), stats.at<int>(label, cv::CC_STAT_HEIGHT));
+		c.area = stats.at<int>(label, cv::CC_STAT_AREA);
+		expected.push_back(c);
+	}
+
+	vector<RunLengthMask::Component> found = runs.components(eightConnected);
+	sort(expected.begin(), expected.end(), byBoxAndArea);
+	sort(found.begin(), found.end(), byBoxAndArea);
+	bool same = found.size() == expected.size();
+	for (size_t i = 0; same && i < found.size(); i++)
+	{
+		same = found[i].box == expected[i].box && found[i].area == expected[i].area;
+	}
+	check(same, eightConnected ? "RunLengthMask::components(8) == connectedComponentsWithStats"
+		: "RunLengthMask::components(4) == connectedComponentsWithStats", trial);
+}
+
+static void checkRunLengthMask(const cv::Mat& plane, int threshold, cv::RNG& rng, int trial)
+{
+	cv::Mat expected = plane >= threshold;
+	RunLengthMask runs = RunLengthMask::fromThreshold(plane, threshold);
+	check(sameMat(runs.toMat(), expected), "RunLengthMask::fromThreshold == plane >= t", trial);
+	check(sameMat(RunLengthMask::fromThreshold(plane, threshold, true).toMat(), plane < threshold),
+		"RunLengthMask::fromThreshold(below) == plane < t", trial);
+	check(sameMat(runs.inverted().toMat(), plane < threshold), "RunLengthMask::inverted", trial);
+
+	cv::Rect roi = randomRoi(rng, plane.size());
+	check(runs.count(roi) == cv::countNonZero(expected(roi)), "RunLengthMask::count(roi)", trial);
+
+	checkComponents(runs, expected, false, trial);
+	checkComponents(runs, expected, true, trial);
+}
+
+int main()
+{
+	const int trials = 500;
+	cv::RNG rng(0x5155);
+	for (int trial = 0; trial < trials; trial++)
+	{
+		cv::Mat plane = randomPlane(rng, trial);
+		// thresholds 0 and 256 give full and empty masks
+		int threshold = trial % 50 == 0 ? 0 : trial % 50 == 1 ? 256 : rng.uniform(1, 256);
+		checkBitMask(plane, threshold, rng, trial);
+		checkRunLengthMask(plane, threshold, rng, trial);
+	}
+
+	if (failures) printf("%d checks failed\n", failures);
+	else printf("%d trials passed\n", trials);
+	return failures ? 1 : 0;
+}
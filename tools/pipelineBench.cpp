@@ -0,0 +1,373 @@
+// Micro-benchmarks of the stages of the pipeline on sample pages.
+// Each case runs one stage over every page, again and again until min_time
+// seconds have been measured; the inputs of a stage are computed beforehand
+// so that only the stage itself is timed.
+// Reports ns per page and pages/s, and writes them as JSON in the format of
+// Google Benchmark (--benchmark_format=json) so that the usual tools compare runs.
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "asyncWriter.hpp"
+#include "bitMask.hpp"
+#include "deskew.hpp"
+#include "histogram.hpp"
+#include "gridCells.hpp"
+#include "pageProcessor.hpp"
+#include "pipeline.hpp"
+
+using namespace std;
+
+static const char* keys =
+	"{help h   |      | print this message}"
+	"{@images  |images/| directory of the sample pages (*.png)}"
+	"{config   |      | detection configuration}"
+	"{templates|images/templates/| directory of the symbol and size templates}"
+	"{json     |bench.json| JSON report, empty for none}"
+	"{filter   |      | only run the cases whose name contains this}"
+	"{min_time |0.5   | seconds measured per case at least}"
+	"{out      |.     | existing directory for the crops of the write case}"
+	"{recall   |      | print the recall of every engine against the cells of the contours engine}";
+
+// a sample page and the inputs of every stage
+struct PageData {
+	string path;
+	cv::Mat image;
+	vector<cv::Mat> planes;
+	vector<square_t> found, sized, rotated, filtered;
+	vector<vector<square_t>> rows;
+	vector<cv::Mat> iconZones;
+	vector<cv::Mat> crops;
+	vector<cv::Rect> cells;
+
+	// scratch space of the stages that modify their input
+	vector<square_t> work, out;
+	ChannelHistograms hsv;
+	RunLengthMask runs;
+};
+
+struct BenchCase {
+	string name;
+	function<void(PageData&)> prepare; // untimed, before each run
+	function<void(PageData&)> run;     // timed
+};
+
+struct BenchResult {
+	string name;
+	int64 iterations;
+	double nsPerPage;
+	double pagesPerSecond;
+};
+
+static void preparePage(PageData& page, const DetectionConfig& config)
+{
+	for (int c = 0; c < 3; c++) {
+		page.planes.push_back(cv::Mat());
+		extractPlane(page.image, c, page.planes.back());
+	}
+
+	findSquares(page.image, page.found, config);
+	filterBySize(page.found, page.sized, config.minSquareWidth, config.maxSquareWidth);
+	page.rotated = page.sized;
+	rotateSquares(page.rotated);
+	page.work = page.rotated;
+	filterOverlappingSquares(page.work, page.filtered, config.overlapTolX, config.overlapTolY);
+	if (page.filtered.empty()) return;
+
+	page.work = page.filtered;
+	page.rows = groupByRow(page.work, config.rowTolerance);
+	cv::Rect bounds(0, 0, page.image.cols, page.image.rows);
+	for (const vector<square_t>& row : page.rows) {
+		cv::Rect zone = cv::Rect(0, row[0][0].y, config.iconZoneWidth, config.iconZoneHeight) & bounds;
+		if (zone.area() > 0) page.iconZones.push_back(page.image(zone));
+		for (const square_t& sq : row) {
+			cv::Rect cell = cv::Rect(sq[0], sq[2]) & bounds;
+			if (cell.area() > 0) {
+				page.crops.push_back(page.image(cell));
+				page.cells.push_back(cell);
+			}
+		}
+	}
+}
+
+static vector<BenchCase> makeCases(const PageProcessor& processor, AsyncWriter& writer, const string& outDirectory)
+{
+	vector<BenchCase> cases;
+	const DetectionConfig& config = processor.config();
+	const TemplateBank& templates = processor.templates();
+	auto nothing = [](PageData&) {};
+
+	for (int c = 0; c < 3; c++) {
+		for (int l = 0; l < config.levels; l++) {
+			cases.push_back({ "findSquares/channel:" + to_string(c) + "/level:" + to_string(l),
+				[](PageData& page) { page.out.clear(); },
+				[c, l, &config](PageData& page) { findSquaresInPlane(page.planes[c], l, page.out, config); } });
+		}
+	}
+	cases.push_back({ "findSquares", nothing,
+		[&config](PageData& page) { findSquares(page.image, page.out, config); } });
+	for (const string& engine : squareDetectorNames()) {
+		SquareDetector detect = findSquareDetector(engine);
+		cases.push_back({ "detect/" + engine, nothing,
+			[detect, &config](PageData& page) { detect(page.image, page.out, config); } });
+	}
+	cases.push_back({ "selectPassesFromHistogram", nothing,
+		[&config](PageData& page) { selectPassesFromHistogram(page.image, config); } });
+	cases.push_back({ "estimateSkew", nothing,
+		[&config](PageData& page) { estimateSkew(page.image, config.maxSkew); } });
+	cases.push_back({ "filterBySize", [](PageData& page) { page.out.clear(); },
+		[&config](PageData& page) { filterBySize(page.found, page.out, config.minSquareWidth, config.maxSquareWidth); } });
+	cases.push_back({ "rotateSquares", [](PageData& page) { page.work = page.sized; },
+		[](PageData& page) { rotateSquares(page.work); } });
+	cases.push_back({ "filterOverlappingSquares", [](PageData& page) { page.work = page.rotated; page.out.clear(); },
+		[&config](PageData& page) { filterOverlappingSquares(page.work, page.out, config.overlapTolX, config.overlapTolY); } });
+	cases.push_back({ "groupByRow", [](PageData& page) { page.work = page.filtered; },
+		[&config](PageData& page) { if (!page.work.empty()) groupByRow(page.work, config.rowTolerance); } });
+	cases.push_back({ "whatSymbols", nothing,
+		[&templates](PageData& page) {
+			for (const cv::Mat& zone : page.iconZones) templates.whatSymbols(zone);
+		} });
+	cases.push_back({ "inkStats", nothing,
+		[&config](PageData& page) {
+			if (page.cells.empty()) return;
+			cv::Rect zone = page.cells[0];
+			for (const cv::Rect& cell : page.cells) zone |= cell;
+			InkIntegral ink(page.image, zone);
+			for (const cv::Rect& cell : page.cells) ink.cellStats(cell, config.inkMargin);
+		} });
+	// threshold levels of the planes: one 0/255 mask per level, or packed in one read
+	cases.push_back({ "thresholdLevels/mask", nothing,
+		[&config](PageData& page) {
+			cv::Mat mask;
+			for (const cv::Mat& plane : page.planes) {
+				for (int l = 1; l < config.levels; l++) mask = plane >= levelThreshold(l, config.levels);
+			}
+		} });
+	cases.push_back({ "thresholdLevels/packed", nothing,
+		[&config](PageData& page) {
+			vector<int> thresholds;
+			for (int l = 1; l < config.levels; l++) thresholds.push_back(levelThreshold(l, config.levels));
+			vector<BitMask> masks;
+			for (const cv::Mat& plane : page.planes) BitMask::fromThresholds(plane, thresholds, masks);
+		} });
+	// binary page as a mask and as runs, queries on the runs
+	cases.push_back({ "binarize/mask", nothing,
+		[](PageData& page) { cv::Mat ink; binarizeInk(page.image, ink); } });
+	cases.push_back({ "binarize/runs", nothing,
+		[](PageData& page) { binarizeInkRuns(page.image); } });
+	cases.push_back({ "runs/projections", [](PageData& page) { page.runs = binarizeInkRuns(page.image); },
+		[](PageData& page) { page.runs.rowProjection(); page.runs.columnProjection(); } });
+	cases.push_back({ "runs/components", [](PageData& page) { page.runs = binarizeInkRuns(page.image).inverted(); },
+		[](PageData& page) { page.runs.components(); } });
+	// HSV histograms: former path (cvtColor, split, one calcHist per channel),
+	// cvtColor then the single pass histogram, fused conversion and histogram
+	cases.push_back({ "computeHistogram/calcHist", nothing,
+		[](PageData& page) {
+			cv::Mat hsv;
+			cv::cvtColor(page.image, hsv, cv::COLOR_BGR2HSV);
+			vector<cv::Mat> channels, hist(3);
+			cv::split(hsv, channels);
+			int histSize = 256, zero = 0;
+			float range[] = { 0, 256 };
+			const float* histRange = { range };
+			for (int c = 0; c < 3; c++) {
+				cv::calcHist(&channels[c], 1, &zero, cv::Mat(), hist[c], 1, &histSize, &histRange, true, false);
+			}
+		} });
+	cases.push_back({ "computeHistogram/cvtColor", nothing,
+		[](PageData& page) {
+			cv::Mat hsv;
+			cv::cvtColor(page.image, hsv, cv::COLOR_BGR2HSV);
+			computeChannelHistograms(hsv);
+		} });
+	cases.push_back({ "computeHistogram/fused", nothing,
+		[](PageData& page) { computeHsvHistograms(page.image, page.hsv); } });
+	// encoding and writing of the crops, as done by my_project
+	cases.push_back({ "writeCrops", nothing,
+		[&writer, outDirectory](PageData& page) {
+			for (size_t i = 0; i < page.crops.size(); i++) {
+				writer.writeImage(outDirectory + "/bench_crop_" + to_string(i) + ".png", page.crops[i]);
+			}
+			writer.flush();
+		} });
+	// every stage but the writes
+	cases.push_back({ "pipeline", nothing,
+		[&processor](PageData& page) { processor.process(page.image); } });
+	return cases;
+}
+
+static BenchResult runCase(const BenchCase& bench, vector<PageData>& pages, double minTime)
+{
+	const double ticksPerNs = cv::getTickFrequency() / 1e9;
+
+	// warm up: caches, lazy allocations of OpenCV
+	for (PageData& page : pages) {
+		bench.prepare(page);
+		bench.run(page);
+	}
+
+	int64 ticks = 0, iterations = 0;
+	do {
+		for (PageData& page : pages) {
+			bench.prepare(page);
+			int64 start = cv::getTickCount();
+			bench.run(page);
+			ticks += cv::getTickCount() - start;
+			iterations++;
+		}
+	} while (ticks < minTime * 1e9 * ticksPerNs);
+
+	BenchResult result;
+	result.name = bench.name;
+	result.iterations = iterations;
+	result.nsPerPage = ticks / ticksPerNs / iterations;
+	result.pagesPerSecond = 1e9 / result.nsPerPage;
+	return result;
+}
+
+static string jsonEscape(const string& s)
+{
+	string out;
+	for (char c : s) {
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+static bool writeJson(const string& path, const string& imagesDirectory, size_t numPages, const vector<BenchResult>& results)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == NULL) return false;
+
+	fprintf(file, "{\n  \"context\": {\n");
+	fprintf(file, "    \"executable\": \"bench\",\n");
+	fprintf(file, "    \"images\": \"%s\",\n", jsonEscape(imagesDirectory).c_str());
+	fprintf(file, "    \"pages\": %d,\n", (int)numPages);
+	fprintf(file, "    \"opencv_version\": \"%s\",\n", CV_VERSION);
+	fprintf(file, "    \"num_threads\": %d\n", cv::getNumThreads());
+	fprintf(file, "  },\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s\",\n", r.name.c_str());
+		fprintf(file, "      \"iterations\": %lld,\n", (long long)r.iterations);
+		fprintf(file, "      \"real_time\": %.1f,\n", r.nsPerPage);
+		fprintf(file, "      \"time_unit\": \"ns\",\n");
+		fprintf(file, "      \"pages_per_second\": %.3f\n", r.pagesPerSecond);
+		fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	return fclose(file) == 0;
+}
+
+static vector<cv::Rect> cellRects(const cv::Mat& image, DetectionConfig config, const string& engine)
+{
+	config.engine = engine;
+	vector<cv::Rect> rects;
+	RowClassifier noLabel = [](int, const cv::Mat&) { return SymbolLabel(); };
+	for (const DetectedCell& cell : detectCells(image, config, findSquareDetector(engine), noLabel)) rects.push_back(cell.rect);
+	return rects;
+}
+
+// cells of the contours engine found by each engine (intersection over union >= 0.5)
+static void printEngineRecall(const vector<PageData>& pages, const DetectionConfig& config)
+{
+	vector<vector<cv::Rect>> reference;
+	for (const PageData& page : pages) reference.push_back(cellRects(page.image, config, "contours"));
+
+	for (const string& engine : squareDetectorNames())
+	{
+		size_t expected = 0, matched = 0, found = 0;
+		for (size_t p = 0; p < pages.size(); p++)
+		{
+			vector<cv::Rect> cells = cellRects(pages[p].image, config, engine);
+			found += cells.size();
+			expected += reference[p].size();
+			for (const cv::Rect& want : reference[p])
+			{
+				for (const cv::Rect& cell : cells)
+				{
+					double overlap = (want & cell).area();
+					if (overlap >= 0.5 * (want.area() + cell.area() - overlap)) { matched++; break; }
+				}
+			}
+		}
+		printf("%-12s recall %6.2f%% (%zu/%zu cells), %zu cells found\n", engine.c_str(),
+			expected ? 100. * matched / expected : 100., matched, expected, found);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	cv::CommandLineParser parser(argc, argv, keys);
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	const string imagesDirectory = parser.get<cv::String>("@images");
+	const string jsonPath = parser.get<cv::String>("json");
+	const string filter = parser.get<cv::String>("filter");
+	const string outDirectory = parser.get<cv::String>("out");
+	const double minTime = parser.get<double>("min_time");
+
+	shared_ptr<TemplateBank> templates = make_shared<TemplateBank>();
+	if (!templates->load(parser.get<cv::String>("templates"))) return 1;
+	DetectionConfig config;
+	if (!loadConfigOption(parser, config)) return 1;
+	// no symbol cache: every page runs the whole pipeline
+	const PageProcessor processor(config, templates, false);
+	if (!processor.isValid()) return 1;
+
+	vector<cv::String> files;
+	cv::glob(imagesDirectory + "/*.png", files, false);
+	vector<PageData> pages;
+	for (const cv::String& file : files)
+	{
+		PageData page;
+		page.path = file;
+		page.image = cv::imread(file);
+		if (page.image.empty()) continue;
+		preparePage(page, processor.config());
+		pages.push_back(page);
+	}
+	if (pages.empty())
+	{
+		cout << "No page in " << imagesDirectory << endl;
+		return 1;
+	}
+	cout << pages.size() << " pages" << endl;
+	if (parser.has("recall")) printEngineRecall(pages, processor.config());
+
+	AsyncWriter writer;
+	vector<BenchResult> results;
+	for (const BenchCase& bench : makeCases(processor, writer, outDirectory))
+	{
+		if (!filter.empty() && bench.name.find(filter) == string::npos) continue;
+		BenchResult result = runCase(bench, pages, minTime);
+		results.push_back(result);
+		printf("%-32s %14.0f ns/page %10.2f pages/s %8lld iterations\n",
+			result.name.c_str(), result.nsPerPage, result.pagesPerSecond, (long long)result.iterations);
+	}
+
+	if (!jsonPath.empty())
+	{
+		if (!writeJson(jsonPath, imagesDirectory, pages.size(), results))
+		{
+			cout << "Couldn't write " << jsonPath << endl;
+			return 1;
+		}
+		cout << "report: " << jsonPath << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,68 @@
+// Sends pages to my_project -daemon and prints the cells found in each one
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "daemonServer.hpp"
+
+using namespace std;
+
+static void help()
+{
+	cout <<
+		"Usage:\n"
+		"  squares_client <socket> [page.png...]  send the pages to the daemon listening on socket,\n"
+		"                                         read the page paths from stdin when none is given\n"
+		"Each response is \"OK <cells>\" followed by one line per cell:\n"
+		"  row column x y width height label size output\n"
+		<< endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		help();
+		return 1;
+	}
+
+	int fd = DaemonServer::connectTo(argv[1]);
+	if (fd < 0)
+	{
+		cerr << "Couldn't connect to " << argv[1] << endl;
+		return 1;
+	}
+
+	vector<string> pages(argv + 2, argv + argc);
+	bool fromStdin = pages.empty();
+	size_t next = 0;
+
+	int failures = 0;
+	string page, response;
+	for (;;)
+	{
+		if (fromStdin)
+		{
+			if (!getline(cin, page)) break;
+			if (page.empty()) continue;
+		}
+		else
+		{
+			if (next == pages.size()) break;
+			page = pages[next++];
+		}
+
+		if (!DaemonServer::sendMessage(fd, page) || !DaemonServer::receiveMessage(fd, response))
+		{
+			cerr << "Connection to the daemon lost" << endl;
+			DaemonServer::closeSocket(fd);
+			return 1;
+		}
+		if (response.compare(0, 3, "OK ") != 0) failures++;
+		cout << page << ": " << response << flush;
+	}
+
+	DaemonServer::closeSocket(fd);
+	return failures == 0 ? 0 : 2;
+}